@@ -9,6 +9,7 @@ data_fuzzline_file = ""
 
 -- grid
 grid_type      = "grid_1D_sphere"  -- grid geometry; must match input model
+grid_huge_pages = 0                -- 1 = back the large per-zone arrays by transparent huge pages
 
 -- job run (i.e., checkpoint/restart) parameters
 run_do_restart              = 0
@@ -22,6 +23,8 @@ run_chk_simtime_interval    = 0.
 run_chk_walltime_max_buffer = 0.
 run_chk_walltime_max       = 0.
 run_chk_number_start        = 0 -- number of first checkpoint file
+run_memory_limit            = 0 -- memory per rank in MB (0 = no limit)
+run_memory_limit_abort      = 0 -- 1 = exit (rather than warn) when over run_memory_limit
 
 -- default hydro module is none
 hydro_module      = "none"
@@ -51,6 +54,13 @@ transport_store_Jnu              = 1
 transport_use_ddmc               = 0
 transport_ddmc_tau_threshold     = 100
 transport_fleck_alpha            = 0
+transport_n_batches              = 0   -- # of particle batches used to estimate tally errors (0 = don't)
+transport_opacity_pipeline_blocks = 4  -- # of rounds each MPI rank's opacities are calculated and sent in (overlaps the two)
+transport_node_shared_opacities  = 0   -- 1 = keep opacity/emissivity arrays in memory shared by the MPI ranks on a node
+transport_zone_balance           = 0   -- 1 = redraw the MPI ranks' zone blocks each step to even out the opacity work
+transport_zone_balance_tolerance = 1.1 -- redraw them only if the slowest rank took this many times the mean
+transport_particle_balance       = 0   -- 1 = move particles among the MPI ranks each step to even out their estimated work
+transport_particle_balance_tolerance = 1.1 -- move them only if the busiest rank has this many times the mean work
 
 -- whether or not to fix RNG seed
 transport_fix_rng_seed           = 0
@@ -81,6 +91,14 @@ particles_n_emit_pointsources  = 0
 particles_pointsource_file     = ""
 particles_last_iter_pump        = 1
 multiply_particles_n_emit_by_dt_over_dtmax = 0
+particles_emit_stratified      = 1  -- 1 = stratified allocation of emitted particles to zones; 0 = independent draws
+particles_comb_n_per_zone      = 0  -- target # of census particles per zone (0 = no population control)
+particles_comb_n_bands         = 1  -- # of frequency bands in which zone energy is conserved when combing
+particles_comb_tolerance       = 2  -- comb zones with more than tolerance*target (or fewer than target/tolerance) particles
+particles_target_relerr        = 0  -- adapt # of emitted particles to reach this tally relative error (0 = fixed)
+particles_step_max_walltime    = 0  -- when adapting, limit particle propagation to this many secs per step (0 = no limit)
+particles_emit_scale_min       = 0.01  -- min factor by which adaptive emission may scale the emitted particle numbers
+particles_emit_scale_max       = 100   -- max factor by which adaptive emission may scale the emitted particle numbers
 force_rprocess_heating         = 0
 
 -- time stepping
@@ -97,6 +115,14 @@ output_write_radiation            = 0
 output_write_plt_file_time        = 1
 output_write_plt_log_space        = 0  -- use logarithimic spacing of write times
 output_write_mass_fractions       = 0
+output_write_event_counts         = 0  -- counts of scatterings, crossings etc. in each zone
+output_timing                     = 0  -- time the phases of each step
+output_timing_file                = "timing.csv"
+output_timing_counters            = 0  -- also read hardware counters (IPC, cache/branch/TLB misses)
+output_trace                      = 0  -- write a timeline of the phases (Chrome trace-event JSON)
+output_trace_file                 = "trace.json"
+output_trace_events               = 100000  -- most recent phases kept per thread
+output_memory                     = 0  -- print the accounted and resident memory each step
 
 -- limiting values for calculation
 limits_temp_max = 1e8
@@ -127,6 +153,7 @@ opacity_no_scattering       		= 0
 dont_decay_composition      		= 0
 
 opacity_compton_scatter_photons = 0;
+opacity_compton_sampler         = "rejection"  -- Compton angle sampling: "rejection" or "direct" (Kahn's method; see cs_test)
 
 -- line treatment parameters
 line_velocity_width         = 0
@@ -141,6 +168,7 @@ spectrum_nu_grid   = {1,1,1}
 spectrum_n_mu      = 1
 spectrum_n_phi     = 1
 spectrum_suppress_txt = 0
+spectrum_thread_copies_max_mb = 0  -- memory (MB) per spectrum for per-thread copies to count escapes into (0 = count atomically into the spectrum)
 
 -- output gamma-ray spectrum
 gamma_name     = ""
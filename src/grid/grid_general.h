@@ -25,6 +25,7 @@
 
 #include "sedona.h"
 #include "zone.h"
+#include "large_array.h"
 #include "ParameterReader.h"
 #include "h5utils.h"
 
@@ -58,8 +59,8 @@ class grid_general
   std::string grid_type;
 
   // vector of zones
-  std::vector<zone> z;
-  std::vector<zone> z_new; // For restart debugging
+  std::vector<zone, large_array_allocator<zone> > z;
+  std::vector<zone, large_array_allocator<zone> > z_new; // For restart debugging
   int n_zones;
   int n_zones_new;
 
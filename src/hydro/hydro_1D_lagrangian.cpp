@@ -9,6 +9,7 @@
 
 #include "hydro_1D_lagrangian.h"
 #include "physical_constants.h"
+#include "phase_timer.h"
 namespace pc = physical_constants;
 
 
@@ -118,6 +119,7 @@ double hydro_1D_lagrangian::get_time_step()
 
 void hydro_1D_lagrangian::step(double dt)
 {
+  phase_timer timer("hydro");
 
   // add mass to inner zone
   //grid->z[0].mass  += Mdot*dt;
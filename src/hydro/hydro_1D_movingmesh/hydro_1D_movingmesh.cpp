@@ -8,6 +8,7 @@
 
 #include "hydro_1D_movingmesh.h"
 #include "physical_constants.h"
+#include "phase_timer.h"
 namespace pc = physical_constants;
 
 
@@ -100,6 +101,7 @@ double hydro_1D_movingmesh::get_time_step()
 //------------------------------------------------------------
 void hydro_1D_movingmesh::step(double dt )
 {
+  phase_timer timer("hydro");
   // NEED TO PUT data in place
 
    struct Hydro1DMovingMeshCell * theCells = theDomain->theCells;
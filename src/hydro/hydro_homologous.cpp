@@ -5,6 +5,7 @@
 #include "radioactive.h"
 #include <stdlib.h>
 #include "physical_constants.h"
+#include "phase_timer.h"
 
 namespace pc = physical_constants;
 
@@ -26,6 +27,7 @@ double hydro_homologous::get_time_step()
 
 void hydro_homologous::step(double dt)
 {
+  phase_timer timer("hydro");
   double e = (grid->t_now+dt)/grid->t_now;
 
   //if (grid->is_snr_system)
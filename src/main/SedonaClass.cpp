@@ -17,6 +17,8 @@
 #include "hydro_homologous.h"
 #include "hydro_1D_lagrangian.h"
 #include "transport.h"
+#include "phase_timer.h"
+#include "memory_accounts.h"
 
 #ifdef MPI_PARALLEL
 #include <mpi.h>
@@ -76,6 +78,7 @@ int n_threads = 1;
 
   // evolve the entire system in time (or iteration)
   evolve_system();
+  phase_timers().write_trace();
 
   // printout completion
   if (verbose_)
@@ -125,6 +128,18 @@ void SedonaClass::setup()
   int do_checkpoint_test = params_.getScalar<int>("run_do_checkpoint_test");
   i_chk_ = params_.getScalar<int>("run_chk_number_start");
 
+  // timers of the phases of each step
+  phase_timers().init(params_.getScalar<int>("output_timing"),
+    params_.getScalar<string>("output_timing_file"),verbose_,
+    params_.getScalar<int>("output_timing_counters"));
+  if (params_.getScalar<int>("output_trace"))
+    phase_timers().init_trace(params_.getScalar<string>("output_trace_file"),
+      params_.getScalar<int>("output_trace_events"));
+
+  // accounts of the memory the subsystems allocate
+  memory_accounts().init(params_.getScalar<double>("run_memory_limit"),
+    params_.getScalar<int>("run_memory_limit_abort"),verbose_);
+
   std::string restart_file;
   if (do_restart_)
   {
@@ -178,6 +193,9 @@ void SedonaClass::setup()
     if(verbose_) cerr << "# ERROR: the grid type is not implemented" << endl;
     exit(3);
   }
+  // back the large per-zone arrays by huge pages if wanted
+  large_array_huge_pages() = params_.getScalar<int>("grid_huge_pages");
+
   // initialize the grid (including reading the model file)
   grid_->init(&params_);
 
@@ -216,6 +234,7 @@ void SedonaClass::setup()
     transport_ = new transport;
     transport_->init(&params_, grid_);
   }
+  memory_accounts().report("before the first step");
 
   // you can immediately write out a checkpoint to test correctness
   if ((do_restart_) && (do_checkpoint_test))
@@ -295,6 +314,7 @@ void SedonaClass::evolve_system()
   int write_mass_fracs  = params_.getScalar<int>("output_write_mass_fractions");
   double write_out_step = params_.getScalar<double>("output_write_plt_file_time");
   double write_out_log  = params_.getScalar<double>("output_write_plt_log_space");
+  int output_memory     = params_.getScalar<int>("output_memory");
   int    i_write = 0;
   double next_write_out = grid_->t_now;
 
@@ -315,6 +335,7 @@ void SedonaClass::evolve_system()
   //for(int it=1; it<=n_steps; it++,t+=dt_)
   {
     start_step_wt_ = get_timer();
+    phase_timer step_timer("step");
     // get this time step
     if (!steady_iterate)
     {
@@ -363,6 +384,7 @@ void SedonaClass::evolve_system()
     // writeout output files when appropriate
     if ((t_ >= next_write_out)||(steady_iterate))
     {
+      phase_timer output_timer("output");
       double t_write = t_ + dt_;
       if (steady_iterate) t_write = t_;
 
@@ -376,6 +398,8 @@ void SedonaClass::evolve_system()
           transport_->write_radiation_file(i_write+1);
           if(write_levels) transport_->write_levels_to_plotfile(i_write+1);
         }
+        if (use_transport_) transport_->write_tally_errors_to_plotfile(i_write+1);
+        if (use_transport_) transport_->write_zone_events_to_plotfile(i_write+1);
       }
 
       //write spectrum
@@ -404,10 +428,16 @@ void SedonaClass::evolve_system()
 #endif
     if ((do_checkpoint_) && (chk_now))
     {
+      phase_timer checkpoint_timer("checkpoint");
       write_checkpoint(i_chk_);
       i_chk_++;
     }
 
+    // report where the time of the step went
+    step_timer.stop();
+    phase_timers().report(it_,t_);
+    if (output_memory) memory_accounts().report_step(it_);
+
     // check for end
     if ((!steady_iterate)&&(t_ > t_stop)) break;
     it_++;
@@ -512,6 +542,7 @@ void SedonaClass::write_checkpoint(std::string checkpoint_file_full)
   grid_->writeCheckpointZones(checkpoint_file_full);
   transport_->writeCheckpointSpectra(checkpoint_file_full);
   transport_->writeCheckpointRNG(checkpoint_file_full);
+  transport_->writeCheckpointEmitScale(checkpoint_file_full);
   grid_->writeCheckpointGrid(checkpoint_file_full);
   last_chk_timestep_ = it_;
   last_chk_walltime_ = get_timer();
@@ -1,4 +1,5 @@
 #include "SedonaClass.h"
+#include <iostream>
 
 #ifdef MPI_PARALLEL
 #include <mpi.h>
@@ -8,7 +9,17 @@ int main(int argc, char **argv)
 {
   // initialize MPI parallelism
 #ifdef MPI_PARALLEL
-    MPI_Init( &argc, &argv );
+    // only the master thread of OpenMP regions makes MPI calls
+    int provided;
+    MPI_Init_thread( &argc, &argv, MPI_THREAD_FUNNELED, &provided );
+    if (provided < MPI_THREAD_FUNNELED)
+    {
+      int my_rank;
+      MPI_Comm_rank( MPI_COMM_WORLD, &my_rank );
+      if (my_rank == 0)
+        std::cerr << "# WARNING: MPI does not support MPI_THREAD_FUNNELED; "
+          << "opacities will be sent after they are all calculated, not overlapped\n";
+    }
 #endif
 
   // get name of parameter file -- default is defined in sedona.h
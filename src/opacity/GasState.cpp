@@ -2,6 +2,7 @@
 #include <algorithm>
 #include "physical_constants.h"
 #include "GasState.h"
+#include "phase_timer.h"
 #include <iostream>
 #include <fstream>
 #include <iomanip>
@@ -207,6 +208,8 @@ int GasState::solve_state()
 //-----------------------------------------------------------
 int GasState::solve_state(std::vector<real>& J_nu)
 {
+  phase_timer timer("solve_state");
+
   // set key properties of all atoms
   for (size_t i=0;i<atoms.size();++i)
   {
@@ -446,7 +449,46 @@ void GasState::print()
 }
 
 
+//---------------------------------------------------------
+// write the ionization and level populations of the current
+// state to the file zone_<iz>.h5
+//---------------------------------------------------------
 void GasState::write_levels(int iz)
+{
+  std::vector<double> data;
+  get_levels(data);
+  write_levels(iz,data);
+}
+
+//---------------------------------------------------------
+// pack the ionization fractions, level fractions, level
+// departures and number density of each atom into data, in
+// the order write_levels expects.  This only reads the
+// state, so threads can call it concurrently
+//---------------------------------------------------------
+void GasState::get_levels(std::vector<double>& data)
+{
+  data.clear();
+  for(size_t j=0;j<atoms.size();j++)
+  {
+    for(int k=0;k<elem_Z[j]+1;k++)
+      data.push_back(get_ionization_fraction(j,k));
+    int this_nl = atoms[j].n_levels_;
+    for(int k=0;k<this_nl;k++)
+      data.push_back(get_level_fraction(j,k));
+    for(int k=0;k<this_nl;k++)
+      data.push_back(get_level_departure(j,k));
+    data.push_back(dens_ * mass_frac[j]/(elem_A[j]*pc::m_p));
+  }
+}
+
+//---------------------------------------------------------
+// write level data packed by get_levels (on any gas state
+// with the same atoms) to the file zone_<iz>.h5.  HDF5
+// calls are not thread safe, so only one thread at a time
+// may call this
+//---------------------------------------------------------
+void GasState::write_levels(int iz, const std::vector<double>& data)
 {
   char zonefile[1000];
   sprintf(zonefile,"zone_%d.h5",iz);
@@ -454,6 +496,7 @@ void GasState::write_levels(int iz)
 
   const int RANK = 1;
 
+  const double *d = data.data();
   for(size_t j=0;j<atoms.size();j++)
   {
     char afile[100];
@@ -461,33 +504,22 @@ void GasState::write_levels(int iz)
     sprintf(afile,"Z_%d",this_Z);
     hid_t atom_id = H5Gcreate1(file_id,afile,0);
 
-
-    double* tmp_ion = new double[elem_Z[j]+1];
     hsize_t dims_ion[RANK]={(hsize_t)elem_Z[j]+1};
-    for(int k=0;k<elem_Z[j]+1;k++)
-      tmp_ion[k] = get_ionization_fraction(j,k);
-    H5LTmake_dataset(atom_id,"ion_fraction",RANK,dims_ion,H5T_NATIVE_DOUBLE,tmp_ion);
+    H5LTmake_dataset(atom_id,"ion_fraction",RANK,dims_ion,H5T_NATIVE_DOUBLE,d);
+    d += elem_Z[j]+1;
 
     int this_nl = atoms[j].n_levels_;
-    double* tmp_level = new double[this_nl];
     hsize_t dims_level[RANK]={(hsize_t)this_nl};
-    for(int k=0;k<this_nl;k++)
-      tmp_level[k] = get_level_fraction(j,k);
-    H5LTmake_dataset(atom_id,"level_fraction",RANK,dims_level,H5T_NATIVE_DOUBLE,tmp_level);
-    
-    for(int k=0;k<this_nl;k++)
-      tmp_level[k] = get_level_departure(j,k);
-    H5LTmake_dataset(atom_id,"level_departure",RANK,dims_level,H5T_NATIVE_DOUBLE,tmp_level);
+    H5LTmake_dataset(atom_id,"level_fraction",RANK,dims_level,H5T_NATIVE_DOUBLE,d);
+    d += this_nl;
+    H5LTmake_dataset(atom_id,"level_departure",RANK,dims_level,H5T_NATIVE_DOUBLE,d);
+    d += this_nl;
 
-    int this_nd = 1;
-    double* tmp_ndens = new double[this_nd];
-    hsize_t dims_ndens[RANK] = {(hsize_t)this_nd};
-    tmp_ndens[0] = dens_ * mass_frac[j]/(elem_A[j]*pc::m_p);
-    H5LTmake_dataset(atom_id,"n_dens",RANK,dims_ndens,H5T_NATIVE_DOUBLE,tmp_ndens);
+    hsize_t dims_ndens[RANK] = {1};
+    H5LTmake_dataset(atom_id,"n_dens",RANK,dims_ndens,H5T_NATIVE_DOUBLE,d);
+    d += 1;
 
     H5Gclose(atom_id);
-    delete[] tmp_level;
-    delete[] tmp_ion;
   }
   H5Fclose(file_id);
 
@@ -505,6 +537,36 @@ std::string format_with_commas(long int value)
     return numWithCommas;
 }
 
+//------------------------------------------------------------
+// bytes of the atomic data (lines and levels), shared by the
+// gas states
+//------------------------------------------------------------
+double GasState::atomic_data_footprint()
+{
+  double total = 0;
+  for (size_t i=0;i<atoms.size();i++)
+    total += sizeof(AtomicLine)*(double)atoms[i].n_lines_ +
+      sizeof(AtomicLevel)*(double)atoms[i].n_levels_;
+  return total;
+}
+
+//------------------------------------------------------------
+// bytes of the state of the atoms of this gas state: the
+// ion, level and line arrays and, for atoms in NLTE, the
+// rate and solve matrices (n_levels^2 each)
+//------------------------------------------------------------
+double GasState::state_footprint()
+{
+  double total = 0;
+  for (size_t i=0;i<atoms.size();i++)
+  {
+    double nl = atoms[i].n_levels_;
+    total += sizeof(double)*(2.0*atoms[i].n_ions_ + 4*nl + atoms[i].n_lines_);
+    if (atoms[i].use_nlte_) total += sizeof(double)*(2*nl*nl + 2*nl) + sizeof(size_t)*nl;
+  }
+  return total;
+}
+
 void GasState::print_memory_footprint()
 {
     long int n_tot_lines  = 0;
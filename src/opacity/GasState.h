@@ -241,7 +241,11 @@ class GasState
   void print_properties();
   void print();
   void print_memory_footprint();
+  double atomic_data_footprint();
+  double state_footprint();
   void write_levels(int iz);
+  void get_levels(std::vector<double>&);
+  void write_levels(int iz, const std::vector<double>&);
 
 };
 
@@ -1,4 +1,5 @@
 #include "GasState.h"
+#include "phase_timer.h"
 #include "physical_constants.h"
 #include <iostream>
 
@@ -12,7 +13,7 @@ void GasState::computeOpacity(std::vector<OpacityType>& abs,
 			      std::vector<OpacityType>& scat,
 			      std::vector<OpacityType>& tot_emis)
 {
-
+  phase_timer timer("compute_opacity");
 
   int ns = nu_grid_.size();
   std::vector<double> opac, aopac, emis;
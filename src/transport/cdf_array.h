@@ -116,4 +116,58 @@ int size() const
 
 };
 
+//**********************************************************
+// The same operations on a CDF held in memory that belongs
+// to someone else (e.g. one row of a zone_array)
+//**********************************************************
+
+template < class T> class cdf_view
+{
+
+private:
+
+  T  *y;
+  int n;
+
+public:
+
+  cdf_view(T *data, const int size) : y(data), n(size) {}
+
+  T    get(const int i) const    {return y[i];}
+  void set(const int i, T f)     {y[i] = f;}
+  int  size() const              {return n;}
+
+  T get_value(const int i) const
+  {
+    if (i==0) return y[0];
+    else return (y[i] - y[i-1]);
+  }
+
+  // must be called in order
+  void set_value(const int i, T f)
+  {
+    if (i==0) y[0] = f;
+    else y[i] = y[i-1] + f;
+  }
+
+  void normalize()
+  {
+    for (int i=0;i<n;i++) if (std::isnan(y[i])) y[i] = 0;
+    if (y[n-1] == 0) std::fill(y,y+n,1.0);
+    double N = y[n-1];
+    for (int i=0;i<n;i++) y[i] /= N;
+  }
+
+  int sample(const double yval) const
+  {
+    if (n == 1) return 0;
+    return std::upper_bound(y, y+n, yval) - y;
+  }
+
+  void wipe()
+  {
+    std::fill(y,y+n,0.0);
+  }
+};
+
 #endif
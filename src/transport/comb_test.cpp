@@ -0,0 +1,168 @@
+#include <mpi.h>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "transport.h"
+#include "grid_1D_sphere.h"
+#include "test_utils.h"
+
+//---------------------------------------------------------
+// Tests of transport::comb_particles, the population control
+// of census particles.  A few zones of a grid hold too many,
+// too few or about the target number of particles of mixed
+// types and frequencies; after combing, the flagged zones
+// must hold about the target number, the others must be
+// untouched, and the energy of every (zone, group) must be
+// conserved.  With a cap on the total number of particles
+// too low to split the underpopulated zones, those are left
+// alone while the overpopulated ones are still combed
+//---------------------------------------------------------
+
+const int    nz         = 10;
+const int    n_target   = 100;
+const double tolerance  = 2;
+
+//---------------------------------------------------------
+// drives the population control of a transport (friend of
+// transport)
+//---------------------------------------------------------
+class transport_tester
+{
+  transport t_;
+  grid_1D_sphere grid_;
+
+ public:
+
+  transport_tester(int n_bands, int max_particles)
+  {
+    grid_.n_zones = nz;
+    t_.grid = &grid_;
+    t_.verbose = 0;
+    t_.MPI_nprocs = 1;
+    t_.max_total_particles = max_particles;
+    t_.comb_n_per_zone_ = n_target;
+    t_.comb_n_bands_ = n_bands;
+    t_.comb_tolerance_ = tolerance;
+    t_.nu_grid_.init(1e14,1e16,1e14);
+    t_.rangen.init(true,12345);
+  }
+
+  std::vector<particle>& particles() {return t_.particles;}
+  int n_groups() {return t_.comb_n_groups();}
+  int group(const particle &p) {return t_.comb_group(p);}
+  void comb() {t_.comb_particles();}
+};
+
+
+// add n particles of the given type to zone i, with a spread
+// of energies and frequencies
+static void add_particles(std::vector<particle> &ps, int i, int n, PType type)
+{
+  for (int q=0;q<n;q++)
+  {
+    particle p;
+    p.type = type;
+    p.ind  = i;
+    p.t    = 0;
+    p.e    = 0.5 + lcg_uniform();
+    p.nu   = 1e14 + 9.8e15*lcg_uniform();
+    p.fate = moving;
+    random_direction(p.D);
+    for (int j=0;j<3;j++) p.x[j] = 0;
+    ps.push_back(p);
+  }
+}
+
+// particle counts and energies of each zone and (zone, group)
+static void census(transport_tester &tt, std::vector<int> &count, std::vector<double> &E)
+{
+  int ng = tt.n_groups();
+  count.assign(nz,0);
+  E.assign(nz*ng,0);
+  std::vector<particle> &ps = tt.particles();
+  for (size_t q=0;q<ps.size();q++)
+  {
+    count[ps[q].ind]++;
+    E[ps[q].ind*ng + tt.group(ps[q])] += ps[q].e;
+  }
+}
+
+
+//---------------------------------------------------------
+// Comb zones holding the given numbers of photons and
+// gamma-rays/positrons (every third particle), and check
+// which zones were combed (comb_expect) and the energies
+//---------------------------------------------------------
+static bool check_comb(int n_bands, int max_particles, std::vector<int> n_zone,
+  std::vector<char> comb_expect)
+{
+  transport_tester tt(n_bands,max_particles);
+  std::vector<particle> &ps = tt.particles();
+  for (int i=0;i<nz;i++)
+  {
+    add_particles(ps,i,n_zone[i] - 2*(n_zone[i]/3),photon);
+    add_particles(ps,i,n_zone[i]/3,gammaray);
+    add_particles(ps,i,n_zone[i]/3,positron);
+  }
+
+  std::vector<int> count0, count1;
+  std::vector<double> E0, E1;
+  census(tt,count0,E0);
+  tt.comb();
+  census(tt,count1,E1);
+
+  bool ok = true;
+  for (int i=0;i<nz;i++)
+  {
+    if (comb_expect[i])
+      ok = ok && (count1[i] >= n_target/2) && (count1[i] <= n_target + tt.n_groups());
+    else
+      ok = ok && (count1[i] == count0[i]);
+  }
+  for (size_t g=0;g<E0.size();g++)
+    ok = ok && (fabs(E1[g] - E0[g]) <= 1e-12*E0[g]);
+  return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+  MPI_Init(&argc,&argv);
+  int n_fail = 0;
+
+  // zone 0 overpopulated, 1 underpopulated, 3 about right,
+  // and the rest empty
+  std::vector<int> n_zone(nz,0);
+  n_zone[0] = 3000;
+  n_zone[1] = 12;
+  n_zone[3] = 90;
+  std::vector<char> comb_both(nz,0), comb_over(nz,0), comb_none(nz,0);
+  comb_both[0] = comb_both[1] = 1;
+  comb_over[0] = 1;
+  int n_total = 3000 + 12 + 90;
+
+  // only the underpopulated zone
+  std::vector<int> n_under(nz,0);
+  n_under[1] = 12;
+  n_under[2] = 30;
+
+  printf("# %6s %10s %s\n","bands","max_part","case");
+  struct comb_case {int n_bands, max_particles; std::vector<int> n_zone; std::vector<char> expect;
+    const char *what;};
+  std::vector<comb_case> cases = {
+    {1, 10000000, n_zone,  comb_both, "no cap"},
+    {3, 10000000, n_zone,  comb_both, "no cap, 3 frequency bands"},
+    {1, n_total,  n_zone,  comb_over, "cap too low to split"},
+    {3, n_total,  n_zone,  comb_over, "cap too low to split, 3 frequency bands"},
+    {1, 42,       n_under, comb_none, "cap too low to split, none over"},
+  };
+  for (size_t c=0;c<cases.size();c++)
+  {
+    comb_case &m = cases[c];
+    bool ok = check_comb(m.n_bands,m.max_particles,m.n_zone,m.expect);
+    printf("  %6d %10d %s %s\n",m.n_bands,m.max_particles,m.what,check(ok,n_fail));
+  }
+
+  MPI_Finalize();
+  return test_summary("population control",n_fail);
+}
@@ -0,0 +1,147 @@
+#ifndef _COMPTON_SAMPLER_H
+#define _COMPTON_SAMPLER_H 1
+
+#include <math.h>
+#include "physical_constants.h"
+
+//**********************************************************
+// Samplers for Compton scattering, templated on any random
+// number generator with a uniform() method
+//
+// k is the photon energy in units of m_e c^2.  The
+// Klein-Nishina samplers return the cosine of the scattering
+// angle and set E_ratio = E_new/E_old
+//
+// The rejection samplers are the ones transport uses when
+// opacity_compton_sampler = "rejection" (scatter.cpp); the
+// direct ones replace them when it is "direct"
+//**********************************************************
+
+//---------------------------------------------------------
+// Klein-Nishina by rejection: propose an isotropic new
+// direction D_new, and accept it with the differential
+// cross-section at its angle to the old direction D
+//---------------------------------------------------------
+template <class RNG>
+inline double kn_sample_rejection(const double *D, const double k, RNG &rng,
+                                  double *D_new, double &E_ratio)
+{
+  while (true)
+  {
+    // isotropic new direction
+    double mu  = 1 - 2.0*rng.uniform();
+    double phi = 2.0*physical_constants::pi*rng.uniform();
+    double smu = sqrt(1 - mu*mu);
+    D_new[0] = smu*cos(phi);
+    D_new[1] = smu*sin(phi);
+    D_new[2] = mu;
+
+    // angle between old and new directions
+    double cost = D[0]*D_new[0] + D[1]*D_new[1] + D[2]*D_new[2];
+    // new energy ratio (E_new/E_old) at this angle
+    E_ratio = 1/(1 + k*(1 - cost));
+    // klein-nishina differential cross-section, normalized to 1 at cost = 1
+    double diff_cs = 0.5*(E_ratio*E_ratio*(1/E_ratio + E_ratio - 1 + cost*cost));
+    // see if this scatter angle OK
+    if (rng.uniform() < diff_cs) return cost;
+  }
+}
+
+//---------------------------------------------------------
+// Klein-Nishina by Kahn's method, which samples the inverse
+// energy ratio x = E_old/E_new in [1,1+2k] directly
+// Reference: Kahn, AECU-3259 (1954); Everett & Cashwell,
+// LA-5061-MS (1972)
+//---------------------------------------------------------
+template <class RNG>
+inline double kn_sample_kahn(const double k, RNG &rng, double &E_ratio)
+{
+  double x, cost;
+  while (true)
+  {
+    double r1 = rng.uniform();
+    double r2 = rng.uniform();
+    double r3 = rng.uniform();
+    if (r1*(9 + 2*k) <= 1 + 2*k)
+    {
+      x = 1 + 2*k*r2;
+      if (r3*x*x <= 4*(x - 1)) break;
+    }
+    else
+    {
+      x = (1 + 2*k)/(1 + 2*k*r2);
+      cost = 1 - (x - 1)/k;
+      if (r3 <= 0.5*(cost*cost + 1/x)) break;
+    }
+  }
+  E_ratio = 1/x;
+  cost = 1 - (x - 1)/k;
+  if (cost < -1) cost = -1;
+  if (cost >  1) cost =  1;
+  return cost;
+}
+
+//---------------------------------------------------------
+// Cosine of the angle between a photon and a thermal
+// electron of speed beta = v/c, for which the collision rate
+// goes as (1 - beta*cos). Samples the inverse CDF directly
+// (the rejection form accepts with probability 0.5*(1-beta*cos))
+//---------------------------------------------------------
+template <class RNG>
+inline double mb_sample_cosine(const double beta, RNG &rng)
+{
+  double a = 4*rng.uniform() - 2 - beta;
+  return a/(1 + sqrt(1 - beta*a));
+}
+
+//---------------------------------------------------------
+// Velocity direction ed of a thermal electron seen by a
+// photon going in direction D, by rejection: an isotropic
+// direction is accepted with probability 0.5*(1-beta*cos),
+// drawing a new speed (from speed(), with beta = v/c) for
+// each try.  Returns the accepted speed
+//---------------------------------------------------------
+template <class RNG, class Speed>
+inline double mb_sample_rejection(const double *D, Speed speed, const double c,
+                                  RNG &rng, double *ed)
+{
+  while (true)
+  {
+    double v_tot = speed();
+
+    double mu  = 1. - 2.0*rng.uniform();
+    double phi = 2.0*physical_constants::pi*rng.uniform();
+    double smu = sqrt(1 - mu*mu);
+    ed[0] = smu*cos(phi);
+    ed[1] = smu*sin(phi);
+    ed[2] = mu;
+
+    double omega = ed[0]*D[0] + ed[1]*D[1] + ed[2]*D[2];
+    if (rng.uniform() < 0.5*(1. - omega*v_tot/c)) return v_tot;
+  }
+}
+
+//---------------------------------------------------------
+// Set D_new to a unit vector at an angle with cosine mu
+// from unit vector D, at azimuth phi around it
+//---------------------------------------------------------
+inline void rotate_direction(const double *D, const double mu,
+                             const double phi, double *D_new)
+{
+  double smu  = sqrt(1 - mu*mu);
+  double cphi = cos(phi);
+  double sphi = sin(phi);
+  double s    = sqrt(1 - D[2]*D[2]);
+  if (s < 1e-8)
+  {
+    D_new[0] = smu*cphi;
+    D_new[1] = smu*sphi;
+    D_new[2] = (D[2] > 0) ? mu : -mu;
+    return;
+  }
+  D_new[0] = mu*D[0] + smu*(D[0]*D[2]*cphi - D[1]*sphi)/s;
+  D_new[1] = mu*D[1] + smu*(D[1]*D[2]*cphi + D[0]*sphi)/s;
+  D_new[2] = mu*D[2] - smu*cphi*s;
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include "compton_sampler.h"
+#include "test_utils.h"
+
+//---------------------------------------------------------
+// Statistical test and timing of the direct Compton
+// samplers against the rejection samplers they replace,
+// each as transport calls it (scatter.cpp): the new
+// direction of a photon going in direction D, or the
+// direction of the electron it meets.  Histograms of the
+// sampled cosines are compared with a two-sample chi-square
+// test.  (In transport the rejection sampler of the electron
+// also draws a new speed each try, which is left out here)
+//---------------------------------------------------------
+
+const int    n_bins   = 40;
+const int    n_sample = 400000;
+// 99.9% point of the chi-square distribution with n_bins-1 dof
+const double chi2_max = 72.1;
+
+// the sampled directions are stored here, so that their
+// calculation is timed rather than optimized away
+volatile double sink;
+
+static void add_to_hist(std::vector<double> &h, double cost)
+{
+  int i = (cost + 1)/2.0*n_bins;
+  if (i < 0) i = 0;
+  if (i >= n_bins) i = n_bins - 1;
+  h[i] += 1;
+}
+
+static double chi2_two_sample(const std::vector<double> &a, const std::vector<double> &b)
+{
+  double chi2 = 0;
+  for (int i=0;i<n_bins;i++)
+    if (a[i] + b[i] > 0) chi2 += (a[i] - b[i])*(a[i] - b[i])/(a[i] + b[i]);
+  return chi2;
+}
+
+int main()
+{
+  int n_fail = 0;
+  test_RNG rng;
+
+  // the incoming photon direction
+  double D[3] = {0.36, 0.48, 0.8};
+  double D_new[3];
+
+  printf("# Klein-Nishina: k = E/(m_e c^2)\n");
+  printf("# %10s %10s %10s %10s %10s %10s\n","k","chi2","<E_rat>rej","<E_rat>dir","t_rej(s)","t_dir(s)");
+  double ks[] = {1e-3, 0.01, 0.1, 0.5, 1.0, 2.5, 10.0};
+  for (size_t n=0;n<sizeof(ks)/sizeof(ks[0]);n++)
+  {
+    double k = ks[n];
+    std::vector<double> h_rej(n_bins,0), h_dir(n_bins,0);
+    double E_ratio, Esum_rej = 0, Esum_dir = 0;
+
+    double t0 = wall_time();
+    for (int q=0;q<n_sample;q++)
+    {
+      add_to_hist(h_rej,kn_sample_rejection(D,k,rng,D_new,E_ratio));
+      sink = D_new[0];
+      Esum_rej += E_ratio;
+    }
+    double t1 = wall_time();
+    for (int q=0;q<n_sample;q++)
+    {
+      double cost = kn_sample_kahn(k,rng,E_ratio);
+      rotate_direction(D,cost,2.0*physical_constants::pi*rng.uniform(),D_new);
+      sink = D_new[0];
+      add_to_hist(h_dir,cost);
+      Esum_dir += E_ratio;
+    }
+    double t2 = wall_time();
+
+    double chi2 = chi2_two_sample(h_rej,h_dir);
+    printf("  %10.3e %10.2f %10.6f %10.6f %10.4f %10.4f %s\n",k,chi2,
+      Esum_rej/n_sample,Esum_dir/n_sample,t1 - t0,t2 - t1,
+      check(chi2 <= chi2_max,n_fail));
+  }
+
+  printf("# Thermal electron angle: beta = v/c\n");
+  printf("# %10s %10s %10s %10s %10s %10s\n","beta","chi2","<mu>rej","<mu>dir","t_rej(s)","t_dir(s)");
+  double betas[] = {1e-3, 0.05, 0.3, 0.7, 0.99};
+  for (size_t n=0;n<sizeof(betas)/sizeof(betas[0]);n++)
+  {
+    double beta = betas[n];
+    std::vector<double> h_rej(n_bins,0), h_dir(n_bins,0);
+    double mu_rej = 0, mu_dir = 0;
+
+    double t0 = wall_time();
+    for (int q=0;q<n_sample;q++)
+    {
+      double ed[3];
+      mb_sample_rejection(D,[&]() {return beta;},1.0,rng,ed);
+      double mu = ed[0]*D[0] + ed[1]*D[1] + ed[2]*D[2];
+      sink = ed[0];
+      add_to_hist(h_rej,mu);
+      mu_rej += mu;
+    }
+    double t1 = wall_time();
+    for (int q=0;q<n_sample;q++)
+    {
+      double ed[3];
+      double mu = mb_sample_cosine(beta,rng);
+      rotate_direction(D,mu,2.0*physical_constants::pi*rng.uniform(),ed);
+      sink = ed[0];
+      add_to_hist(h_dir,mu);
+      mu_dir += mu;
+    }
+    double t2 = wall_time();
+
+    double chi2 = chi2_two_sample(h_rej,h_dir);
+    printf("  %10.3e %10.2f %10.6f %10.6f %10.4f %10.4f %s\n",beta,chi2,
+      mu_rej/n_sample,mu_dir/n_sample,t1 - t0,t2 - t1,
+      check(chi2 <= chi2_max,n_fail));
+  }
+
+  // check that rotated directions stay unit vectors at the right angle
+  double max_err = 0;
+  for (int q=0;q<n_sample;q++)
+  {
+    double D[3], D_new[3];
+    random_direction(D);
+    if (q == 0) {D[0] = 0; D[1] = 0; D[2] = -1;}
+    double mu = 1 - 2.0*rng.uniform();
+    rotate_direction(D,mu,2*M_PI*rng.uniform(),D_new);
+    double norm = D_new[0]*D_new[0] + D_new[1]*D_new[1] + D_new[2]*D_new[2];
+    double cost = D[0]*D_new[0] + D[1]*D_new[1] + D[2]*D_new[2];
+    if (fabs(norm - 1) > max_err) max_err = fabs(norm - 1);
+    if (fabs(cost - mu) > max_err) max_err = fabs(cost - mu);
+  }
+  printf("# rotate_direction max error = %e %s\n",max_err,check(max_err <= 1e-10,n_fail));
+
+  return test_summary("Compton sampler",n_fail);
+}
@@ -29,10 +29,13 @@ ParticleFate transport::discrete_diffuse_IMD(particle &p, double dt)
   // set this zone
   while (!stop)
   {
+    count_event();
+
     // find current zone and check for escape
     p.ind = grid->get_zone(p.x);
     if (p.ind == -1) {return absorbed;}
     if (p.ind == -2) {return escaped;}
+    count_zone_event(p.ind,zev_ddmc);
 
     // pointer to current zone
     zone *zone = &(grid->z[p.ind]);
@@ -43,6 +46,7 @@ ParticleFate transport::discrete_diffuse_IMD(particle &p, double dt)
     //zone->e_rad += p.e*ddmc_P_stay_[p.ind];
     #pragma omp atomic
     J_nu_[p.ind][0] += p.e*ddmc_P_stay_[p.ind]*dt*pc::c;
+    tally_batch(p.ind,p.e*ddmc_P_abs_[p.ind],p.e*ddmc_P_stay_[p.ind]*dt*pc::c);
 
     // total probability of diffusing in some direction
     double P_diff = ddmc_P_up_[p.ind]  + ddmc_P_dn_[p.ind];
@@ -129,8 +133,11 @@ ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
 
   while (fate == moving)
   {
+    count_event();
+
     // indices of current and adjacent zones
     int ii = p.ind;
+    count_zone_event(ii,zev_ddmc);
     int ip = ii + 1;
     int im = ii - 1;
 
@@ -257,6 +264,7 @@ ParticleFate transport::discrete_diffuse_DDMC(particle &p, double tstop)
     J_nu_[p.ind][0] += p.e*this_d;
     #pragma omp atomic
     grid->z[p.ind].e_abs  += (p.e*dshift)*this_d*sigma_i*eps_i_cmf;
+    tally_batch(p.ind,(p.e*dshift)*this_d*sigma_i*eps_i_cmf,p.e*this_d);
 
     // Perform the event with a smaller distance
     if (event == scatter)  // effective scattering
@@ -603,6 +611,7 @@ ParticleFate transport::discrete_diffuse_RandomWalk(particle &p, double t_stop)
   // set this zone
   while (!stop)
   {
+    count_event();
     double dt_remaining = t_stop - p.t;
     if (steady_state) dt_remaining = 1e99;
     assert(dt_remaining > 0);
@@ -613,6 +622,7 @@ ParticleFate transport::discrete_diffuse_RandomWalk(particle &p, double t_stop)
 
     if (p.ind == -1) {return absorbed;}
     if (p.ind == -2) {return escaped;}
+    count_zone_event(p.ind,zev_walk);
 
     // total probability of diffusing to the edge of the sphere
     double D = pc::c/(3.0*planck_mean_opacity_[p.ind]);// * 3./4.;
@@ -649,6 +659,7 @@ ParticleFate transport::discrete_diffuse_RandomWalk(particle &p, double t_stop)
     J_nu_[p.ind][0] += p.e*dt_step*pc::c;
     #pragma omp atomic
     grid->z[p.ind].e_abs  += p.e*dt_step*pc::c*planck_mean_opacity_[p.ind];
+    tally_batch(p.ind,p.e*dt_step*pc::c*planck_mean_opacity_[p.ind],p.e*dt_step*pc::c);
 
     // move the particle a distance R_diffuse
     double diffuse_dir[3];
@@ -686,6 +697,7 @@ ParticleFate transport::discrete_diffuse_RandomWalk(particle &p, double t_stop)
 // ------------------------------------------------------
 void transport::compute_diffusion_probabilities(double dt)
 {
+  phase_timer timer("ddmc_setup");
   int nz = grid->n_zones;
 
   double dtau_ddmc = 0.0, dtau_mc = 0.0;
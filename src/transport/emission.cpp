@@ -14,6 +14,7 @@ using std::endl;
 //------------------------------------------------------------
 void transport::emit_particles(double dt)
 {
+  phase_timer timer("emission");
   emit_radioactive(dt);
   emit_thermal(dt);
   //emit_heating_source(dt);
@@ -55,7 +56,22 @@ void transport::create_isotropic_particle
 (int i, PType type, double Ep, double t)
 {
   particle p;
+  setup_isotropic_particle(p,i,type,Ep,t);
 
+  // add to particle vector
+  #pragma omp critical
+  particles.push_back(p);
+}
+
+
+//------------------------------------------------------------
+// Set up particle p in zone i, emitted isotropically in the
+// comoving frame.  Does not touch the particle vector, so
+// it can be called in parallel on pre-allocated slots
+//------------------------------------------------------------
+void transport::setup_isotropic_particle
+(particle &p, int i, PType type, double Ep, double t)
+{
   // particle index
   p.ind = i;
 
@@ -97,11 +113,45 @@ void transport::create_isotropic_particle
 
   // set time to current
   p.t  = t;
+}
 
-  // add to particle vector
-  #pragma omp critical
-  particles.push_back(p);
 
+//------------------------------------------------------------
+// Split n_emit particles among the zones according to
+// zone_emission_cdf_. With stratified emission, the zone
+// counts are laid down systematically (a single random
+// offset), so that each zone gets either the floor or the
+// ceiling of its expected share.  Otherwise each particle
+// samples its zone independently.  On return, the particles
+// of zone i are numbered first[i] to first[i+1]-1
+//------------------------------------------------------------
+void transport::allocate_zone_emission(int n_emit, vector<int>& first)
+{
+  int nz = grid->n_zones;
+  first.assign(nz+1,0);
+
+  if (emit_stratified_)
+  {
+    double u = rangen.uniform();
+    for (int i=0;i<nz;i++)
+    {
+      int n = floor(n_emit*zone_emission_cdf_.get(i) + u);
+      if (n > n_emit) n = n_emit;
+      if (n < first[i]) n = first[i];
+      first[i+1] = n;
+    }
+  }
+  else
+  {
+    for (int q=0;q<n_emit;q++)
+    {
+      int i = zone_emission_cdf_.sample(rangen.uniform());
+      if (i >= nz) i = nz-1;
+      first[i+1]++;
+    }
+    for (int i=0;i<nz;i++) first[i+1] += first[i];
+  }
+  first[nz] = n_emit;
 }
 
 
@@ -111,33 +161,22 @@ void transport::create_isotropic_particle
 //------------------------------------------------------------
 void transport::initialize_particles(int init_particles)
 {
-  int my_n_emit = init_particles/(1.0*MPI_nprocs);
-  // If init_particles % MPI_nprocs != 0, create the remaining particles
-  // on the first remainder nodes.
-  int remainder = init_particles % MPI_nprocs;
-  if (MPI_myID < remainder) {
-    my_n_emit += 1;
-  }
-
-  if (my_n_emit == 0) return;
-   // check that we have enough space to add these particles
-  if (my_n_emit > max_total_particles) {
-      if (verbose) cerr << "# Not enough particle space to initialize" << endl;
-      return; }
+  if (init_particles <= 0) return;
 
-  if (verbose) cout << "# init with " << init_particles << " total particles ";
-  if (verbose) cout << "(" << my_n_emit << " per MPI proc)\n";
-  if (my_n_emit == 0) return;
-
-  // set up emission distribution across zones
+  // set up emission distribution across zones.  Node-shared
+  // emissivities are written by the first rank on the node,
+  // and read by all of them once it is done (every rank must
+  // get here)
   double E_sum = 0;
   int ng = nu_grid_.size();
+  int write_emis = (!node_shared_)||(node_rank_ == 0);
   for (int i=0;i<grid->n_zones;i++)
   {
     double T = grid->z[i].T_gas;
     double E_zone = grid->z[i].e_rad*grid->zone_volume(i);
     zone_emission_cdf_.set_value(i,E_zone);
     E_sum += E_zone;
+    if (!write_emis) continue;
     // setup blackbody emissivity for initialization
     for (int j=0;j<ng;j++)
     {
@@ -148,14 +187,36 @@ void transport::initialize_particles(int init_particles)
     emissivity_[i].normalize();
   }
   zone_emission_cdf_.normalize();
+  node_barrier();
+
+  int my_n_emit = init_particles/(1.0*MPI_nprocs);
+  // If init_particles % MPI_nprocs != 0, create the remaining particles
+  // on the first remainder nodes.
+  int remainder = init_particles % MPI_nprocs;
+  if (MPI_myID < remainder) {
+    my_n_emit += 1;
+  }
+
+  if (my_n_emit == 0) return;
+   // check that we have enough space to add these particles
+  if (my_n_emit > max_total_particles) {
+      if (verbose) cerr << "# Not enough particle space to initialize" << endl;
+      return; }
+
+  if (verbose) cout << "# init with " << init_particles << " total particles ";
+  if (verbose) cout << "(" << my_n_emit << " per MPI proc)\n";
 
   // emit particles
   double Ep = E_sum/(1.0*my_n_emit);
-  for (int q=0;q<my_n_emit;q++)
-  {
-    int i = zone_emission_cdf_.sample(rangen.uniform());
-    create_isotropic_particle(i,photon,Ep,t_now_);
-  }
+  vector<int> first;
+  allocate_zone_emission(my_n_emit,first);
+  size_t n0 = particles.size();
+  particles.resize(n0 + my_n_emit);
+
+  #pragma omp parallel for schedule(dynamic)
+  for (int i=0;i<grid->n_zones;i++)
+    for (int q=first[i];q<first[i+1];q++)
+      setup_isotropic_particle(particles[n0+q],i,photon,Ep,t_now_);
 }
 
 
@@ -166,6 +227,7 @@ void transport::emit_radioactive(double dt)
 {
   // number of radioctive particles to emit
   int total_n_emit = params_->getScalar<int>("particles_n_emit_radioactive");
+  total_n_emit *= emit_scale_;
 
   if (params_->getScalar<int>("multiply_particles_n_emit_by_dt_over_dtmax"))
   {
@@ -219,22 +281,28 @@ void transport::emit_radioactive(double dt)
     return; }
 
   // emit particles
-  for (int q=0;q<my_n_emit;q++)
-  {
-    int i = zone_emission_cdf_.sample(rangen.uniform());
-    double t  = t_now_ + dt*rangen.uniform();
+  vector<int> first;
+  allocate_zone_emission(my_n_emit,first);
+  size_t n0 = particles.size();
+  particles.resize(n0 + my_n_emit);
 
-    // determine if make gamma-ray or positron
-    if (rangen.uniform() < gamma_frac[i])
-      create_isotropic_particle(i,gammaray,E_p,t);
-    else
+  #pragma omp parallel for schedule(dynamic)
+  for (int i=0;i<grid->n_zones;i++)
+    for (int q=first[i];q<first[i+1];q++)
     {
-      // positrons are just immediately made into photons
-      #pragma omp atomic
-      grid->z[i].L_radio_dep += E_p;
-      create_isotropic_particle(i,photon,E_p,t);
+      double t  = t_now_ + dt*rangen.uniform();
+
+      // determine if make gamma-ray or positron
+      if (rangen.uniform() < gamma_frac[i])
+        setup_isotropic_particle(particles[n0+q],i,gammaray,E_p,t);
+      else
+      {
+        // positrons are just immediately made into photons
+        #pragma omp atomic
+        grid->z[i].L_radio_dep += E_p;
+        setup_isotropic_particle(particles[n0+q],i,photon,E_p,t);
+      }
     }
-  }
 
   if (verbose) cout << "# L_radioactive = " << L_tot << " ergs/s; ";
   if (verbose) cout << "added " << total_n_emit << " particles ";
@@ -248,6 +316,7 @@ void transport::emit_thermal(double dt)
 {
   // number of thermal particles to emit
   int total_n_emit = params_->getScalar<int>("particles_n_emit_thermal");
+  total_n_emit *= emit_scale_;
   if (total_n_emit == 0) return;
   int my_n_emit = total_n_emit/(1.0*MPI_nprocs);
 
@@ -276,12 +345,18 @@ void transport::emit_thermal(double dt)
   double E_p = E_tot/(1.0*my_n_emit);
 
   // emit particles
-  for (int q=0;q<my_n_emit;q++)
-  {
-    int i = zone_emission_cdf_.sample(rangen.uniform());
-    double t  = t_now_ + dt*rangen.uniform();
-    create_isotropic_particle(i,photon,E_p,t);
-  }
+  vector<int> first;
+  allocate_zone_emission(my_n_emit,first);
+  size_t n0 = particles.size();
+  particles.resize(n0 + my_n_emit);
+
+  #pragma omp parallel for schedule(dynamic)
+  for (int i=0;i<grid->n_zones;i++)
+    for (int q=first[i];q<first[i+1];q++)
+    {
+      double t  = t_now_ + dt*rangen.uniform();
+      setup_isotropic_particle(particles[n0+q],i,photon,E_p,t);
+    }
 
   if (verbose) cout << "# E thermal = " << E_tot << " ergs; ";
   if (verbose) cout << "added " << total_n_emit << " particles ";
@@ -372,6 +447,7 @@ void transport::emit_inner_source(double dt)
   // get the emisison properties from lua file
   // this could be set to be a function if we want
   int total_n_emit    = params_->getScalar<int>("core_n_emit");
+  total_n_emit *= emit_scale_;
   if (total_n_emit == 0) return;
 
   if (last_iteration_)
@@ -392,9 +468,13 @@ void transport::emit_inner_source(double dt)
     {cerr  << "# Not enough particle space" << endl; return; }
 
   // inject particles from the source
+  size_t n0 = particles.size();
+  particles.resize(n0 + n_emit);
+
+  #pragma omp parallel for
   for (int i=0;i<n_emit;i++)
   {
-    particle p;
+    particle &p = particles[n0+i];
 
     if (r_core_ == 0)
     {
@@ -474,10 +554,6 @@ void transport::emit_inner_source(double dt)
 
     // set type to photon
     p.type = photon;
-
-    // add to particle vector
-    #pragma omp critical
-    particles.push_back(p);
   }
 
   if (verbose)
@@ -504,9 +580,13 @@ void transport::emit_from_pointsoures(double dt)
   double Ep  = pointsources_L_tot_*dt/n_emit;
 
   // inject particles from the source
+  size_t n0 = particles.size();
+  particles.resize(n0 + n_emit);
+
+  #pragma omp parallel for
   for (int i=0;i<n_emit;i++)
   {
-    particle p;
+    particle &p = particles[n0+i];
 
     // pick your pointsource to emit from
     int ind = pointsource_emission_cdf_.sample(rangen.uniform());
@@ -545,10 +625,6 @@ void transport::emit_from_pointsoures(double dt)
 
     // set type to photon
     p.type = photon;
-
-    // add to particle vector
-    #pragma omp critical
-    particles.push_back(p);
   }
 
   if (verbose)
@@ -0,0 +1,206 @@
+#include <mpi.h>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include <omp.h>
+#include "transport.h"
+#include "test_utils.h"
+
+//---------------------------------------------------------
+// Tests of transport::collect_escaped_particles, which
+// moves the particles each thread saw escape into the
+// escaped particle list after propagation.
+//
+// In an escape-dominated step every particle takes a few
+// steps and escapes, and is buffered by its thread as in
+// propagate_particle; the buffers are then collected.  This
+// is timed against pushing onto the list under a critical
+// section, at 1 to 128 threads, and the collected list must
+// hold each particle once.
+//
+// With spectrum_particle_list_maxn set, the list is cleared
+// once it would grow past that size, and collection goes on
+// into the empty list.  The collected list is checked
+// against doing the same one particle at a time, with
+// buffers that cross the limit once, several times and
+// exactly at their ends
+//---------------------------------------------------------
+
+const int n_part  = 2000000;
+const int n_steps = 20;
+
+// a few steps of a random walk, as a stand-in for the work
+// of propagating the particle
+static void walk(particle &p, int q)
+{
+  unsigned long long s = 12345 + 2654435761ULL*q;
+  for (int k=0;k<n_steps;k++)
+  {
+    s = s*6364136223846793005ULL + 1442695040888963407ULL;
+    double d = (s >> 11)*(1.0/9007199254740992.0);
+    for (int j=0;j<3;j++) p.x[j] += d*p.D[j];
+  }
+  p.fate = escaped;
+}
+
+static void make_particle(particle &p, int q)
+{
+  p.type = photon;
+  p.ind  = q;
+  p.t    = 0;
+  p.e    = 1 + (q % 3);
+  p.nu   = 1e15;
+  for (int j=0;j<3;j++) {p.x[j] = 0; p.D[j] = (j == q % 3) ? 1 : 0;}
+}
+
+// check that the list holds each particle once
+static bool check_list(const std::vector<particle> &esc)
+{
+  if ((int)esc.size() != n_part) return false;
+  std::vector<char> seen(n_part,0);
+  for (size_t q=0;q<esc.size();q++)
+  {
+    int i = esc[q].ind;
+    if ((i < 0)||(i >= n_part)||(seen[i])) return false;
+    if (esc[q].e != 1 + (i % 3)) return false;
+    seen[i] = 1;
+  }
+  return true;
+}
+
+
+//---------------------------------------------------------
+// drives the escaped particle lists of a transport (friend
+// of transport)
+//---------------------------------------------------------
+class transport_tester
+{
+  transport t_;
+
+ public:
+
+  transport_tester(int n_threads, double maxn)
+  {
+    t_.MPI_myID = 0;
+    t_.maxn_escaped_particles_ = maxn;
+    t_.escaped_thread_.assign(n_threads,std::vector<particle>());
+  }
+
+  std::vector<particle>& list() {return t_.particles_escaped;}
+  std::vector<particle>& buffer(int t) {return t_.escaped_thread_[t];}
+
+  // propagate n_part particles, buffering them on their
+  // threads, and collect them
+  double collect_buffered()
+  {
+    t_.particles_escaped.clear();
+    double t0 = wall_time();
+    #pragma omp parallel for schedule(guided)
+    for (int q=0;q<n_part;q++)
+    {
+      particle p;
+      make_particle(p,q);
+      walk(p,q);
+      t_.escaped_thread_[omp_get_thread_num()].push_back(p);
+    }
+    t_.collect_escaped_particles();
+    return wall_time() - t0;
+  }
+
+  // the same, pushing onto the list under a critical section
+  double collect_critical()
+  {
+    t_.particles_escaped.clear();
+    double t0 = wall_time();
+    #pragma omp parallel for schedule(guided)
+    for (int q=0;q<n_part;q++)
+    {
+      particle p;
+      make_particle(p,q);
+      walk(p,q);
+      #pragma omp critical
+      t_.particles_escaped.push_back(p);
+    }
+    return wall_time() - t0;
+  }
+
+  void collect() {t_.collect_escaped_particles();}
+};
+
+
+//---------------------------------------------------------
+// Start with n_start particles in the list and the given
+// numbers in the thread buffers, collect them with a
+// maximum list size of maxn, and compare to adding them one
+// at a time (clearing the list whenever it is over maxn)
+//---------------------------------------------------------
+static bool check_max_size(int n_start, std::vector<int> n_buf, double maxn)
+{
+  transport_tester tt(n_buf.size(),maxn);
+  std::vector<particle> expect;
+  int id = 0;
+  for (int q=0;q<n_start;q++)
+  {
+    particle p;
+    make_particle(p,id++);
+    tt.list().push_back(p);
+    expect.push_back(p);
+  }
+  for (size_t t=0;t<n_buf.size();t++)
+    for (int q=0;q<n_buf[t];q++)
+    {
+      particle p;
+      make_particle(p,id++);
+      tt.buffer(t).push_back(p);
+      if (expect.size() > maxn) expect.clear();
+      expect.push_back(p);
+    }
+
+  tt.collect();
+  bool ok = (tt.list().size() == expect.size());
+  for (size_t q=0;(ok)&&(q<expect.size());q++) ok = (tt.list()[q].ind == expect[q].ind);
+  for (size_t t=0;t<n_buf.size();t++) ok = ok && tt.buffer(t).empty();
+  return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+  MPI_Init(&argc,&argv);
+  int n_fail = 0;
+
+  printf("# %8s %10s %10s %8s\n","threads","t_crit(s)","t_buf(s)","speedup");
+  for_thread_counts(128,[&](int nt) {
+    transport_tester tt(nt,1e9);
+
+    // time the second of two steps, once the lists have grown
+    tt.collect_critical();
+    tt.collect_buffered();
+    double t_crit = tt.collect_critical();
+    bool ok = check_list(tt.list());
+    double t_buf  = tt.collect_buffered();
+    ok = ok && check_list(tt.list());
+    printf("  %8d %10.4f %10.4f %8.2f %s\n",nt,t_crit,t_buf,t_crit/t_buf,check(ok,n_fail));
+  });
+
+  // buffers crossing spectrum_particle_list_maxn
+  printf("# %8s %24s %8s\n","start","buffers","maxn");
+  struct max_case {int start; std::vector<int> buf; double maxn;};
+  std::vector<max_case> cases = {
+    {0,   {50,50,50},      1000},  // under the limit
+    {900, {100,100,100},   1000},  // crosses it once
+    {0,   {2500,10,700},   1000},  // crosses it within one buffer, twice
+    {1000,{1,0,1},         1000},  // full, then one over
+    {5,   {3,3,3},         0},     // a limit of (about) one particle
+  };
+  for (size_t c=0;c<cases.size();c++)
+  {
+    max_case &m = cases[c];
+    bool ok = check_max_size(m.start,m.buf,m.maxn);
+    printf("  %8d %8d %7d %7d %8.0f %s\n",m.start,m.buf[0],m.buf[1],m.buf[2],m.maxn,
+      check(ok,n_fail));
+  }
+
+  MPI_Finalize();
+  return test_summary("escape collection",n_fail);
+}
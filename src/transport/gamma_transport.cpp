@@ -0,0 +1,211 @@
+//------------------------------------------------------------
+// gamma_transport.cpp
+// This file contains the transport of gamma-ray particles,
+// which only see grey-in-space, energy dependent compton
+// and photoelectric opacities, and so skip all of the
+// machinery of the optical frequency grid
+//------------------------------------------------------------
+
+#include <math.h>
+#include <limits>
+#include <cassert>
+#include "transport.h"
+#include "physical_constants.h"
+
+namespace pc = physical_constants;
+
+// range and resolution of the gamma-ray opacity tables (MeV)
+static const double gamma_E_min  = 1e-4;
+static const double gamma_E_max  = 1e2;
+static const int    gamma_n_E    = 4096;
+
+
+//------------------------------------------------------------
+// Tabulate the energy dependence of the compton (Klein-Nishina)
+// and photoelectric cross-sections on a grid uniform in log(E)
+//------------------------------------------------------------
+void transport::setup_gamma_opacity_table()
+{
+  gamma_logE_min_ = log(gamma_E_min);
+  gamma_dlogE_    = (log(gamma_E_max) - gamma_logE_min_)/(gamma_n_E - 1);
+  gamma_kn_table_.resize(gamma_n_E);
+  gamma_pe_table_.resize(gamma_n_E);
+  for (int j=0;j<gamma_n_E;j++)
+  {
+    double E = exp(gamma_logE_min_ + j*gamma_dlogE_);
+    gamma_kn_table_[j] = klein_nishina(E);
+    gamma_pe_table_[j] = pow(E,-3.5);
+  }
+
+  // per-thread buffers for the deposited gamma-ray energy
+#ifdef _OPENMP
+  int max_nthreads = omp_get_max_threads();
+#else
+  int max_nthreads = 1;
+#endif
+  L_radio_dep_thread_.assign(max_nthreads*grid->n_zones,0);
+}
+
+
+//------------------------------------------------------------
+// comoving opacity and absorption fraction of a gamma-ray
+// of energy E (MeV) in zone i, interpolated from the tables
+// (or calculated directly if E is off the table)
+//------------------------------------------------------------
+void transport::get_gamma_opacity(int i, double E, double &opac, double &eps)
+{
+  double kn, pe;
+  double x = (log(E) - gamma_logE_min_)/gamma_dlogE_;
+  int j = (int)x;
+  if ((x >= 0)&&(j < gamma_n_E - 1))
+  {
+    double f = x - j;
+    kn = gamma_kn_table_[j] + f*(gamma_kn_table_[j+1] - gamma_kn_table_[j]);
+    pe = gamma_pe_table_[j] + f*(gamma_pe_table_[j+1] - gamma_pe_table_[j]);
+  }
+  else
+  {
+    kn = klein_nishina(E);
+    pe = pow(E,-3.5);
+  }
+
+  double c_opac = compton_opac[i]*kn;
+  double p_opac = photoion_opac[i]*pe;
+  opac = c_opac + p_opac;
+  eps  = p_opac/(c_opac + p_opac);
+}
+
+
+//------------------------------------------------------------
+// Tally gamma-ray energy deposited in zone i into the
+// buffer of this thread
+//------------------------------------------------------------
+void transport::deposit_gamma(int i, double E)
+{
+#ifdef _OPENMP
+  int my_threadID = omp_get_thread_num();
+#else
+  int my_threadID = 0;
+#endif
+  L_radio_dep_thread_[my_threadID*grid->n_zones + i] += E;
+}
+
+
+//------------------------------------------------------------
+// Add the thread buffers of deposited gamma-ray energy
+// into the zones, and clear them
+//------------------------------------------------------------
+void transport::reduce_gamma_deposition()
+{
+  int nz = grid->n_zones;
+  int nt = L_radio_dep_thread_.size()/nz;
+
+  #pragma omp parallel for
+  for (int i=0;i<nz;i++)
+  {
+    double sum = 0;
+    for (int t=0;t<nt;t++)
+    {
+      sum += L_radio_dep_thread_[t*nz + i];
+      L_radio_dep_thread_[t*nz + i] = 0;
+    }
+    grid->z[i].L_radio_dep += sum;
+  }
+}
+
+
+//--------------------------------------------------------
+// Propagate a single gamma-ray particle until it escapes,
+// is absorbed, the time step ends, or it is turned into
+// an optical photon (then returns moving)
+//--------------------------------------------------------
+ParticleFate transport::propagate_gamma(particle &p, double tstop)
+{
+  enum ParticleEvent {scatter, boundary, tstep};
+  ParticleEvent event;
+
+  ParticleFate  fate = moving;
+  while (fate == moving)
+  {
+    count_event();
+    assert(p.ind >= 0);
+    zone *zone = &(grid->z[p.ind]);
+
+    // get distance and index to the next zone boundary
+    double d_bn = 0;
+    int new_ind = grid->get_next_zone(p.x,p.D,p.ind,r_core_,&d_bn);
+
+    // determine the doppler shift from comoving to lab
+    double dshift = dshift_lab_to_comoving(&p);
+
+    // get continuum opacity and absorption fraction (epsilon)
+    double opac_cmf,eps_absorb_cmf;
+    get_gamma_opacity(p.ind,p.nu,opac_cmf,eps_absorb_cmf);
+    double opac_labframe = opac_cmf*dshift;
+
+    // step size to next interaction event
+    double tau_r = -1.0*log(1 - rangen.uniform());
+    double d_sc  = tau_r/opac_labframe;
+    if (opac_labframe == 0) d_sc = std::numeric_limits<double>::infinity();
+
+    // find distance to end of time step
+    double d_tm = (tstop - p.t)*pc::c;
+    if (this->steady_state) d_tm = std::numeric_limits<double>::infinity();
+
+    // find out what event happens (shortest distance)
+    double this_d;
+    if ((d_sc < d_bn)&&(d_sc < d_tm))
+      {event = scatter;    this_d = d_sc;}
+    else if (d_bn < d_tm)
+      {event = boundary;   this_d = d_bn;}
+    else
+      {event = tstep;      this_d = d_tm; }
+
+    // tally radiation force
+    double this_E = p.e*this_d;
+    #pragma omp atomic
+    zone->fx_rad += this_E*dshift*opac_cmf*p.D[0] * dshift;
+    #pragma omp atomic
+    zone->fy_rad += this_E*dshift*opac_cmf*p.D[1] * dshift;
+    #pragma omp atomic
+    zone->fz_rad += this_E*dshift*opac_cmf*p.D[2] * dshift;
+    double rr = sqrt(p.x[0]*p.x[0] + p.x[1]*p.x[1] + p.x[2]*p.x[2]);
+    double xdotD = p.x[0]*p.D[0] + p.x[1]*p.D[1] + p.x[2]*p.D[2];
+    #pragma omp atomic
+    zone->fr_rad += this_E*dshift*opac_cmf*xdotD/rr * dshift;
+
+    // move particle the distance
+    p.x[0] += this_d*p.D[0];
+    p.x[1] += this_d*p.D[1];
+    p.x[2] += this_d*p.D[2];
+    p.t = p.t + this_d/pc::c;
+
+    if (event == boundary)
+    {
+      count_zone_event(p.ind,zev_zone_cross);
+      if (((new_ind == -1)&&(boundary_in_reflect_))||
+          ((new_ind == -2)&&(boundary_out_reflect_)))
+      {
+        p.D[0] *= -1;
+        p.D[1] *= -1;
+        p.D[2] *= -1;
+      }
+      else
+      {
+        p.ind = new_ind;
+        if (new_ind == -1) fate = absorbed;
+        if (new_ind == -2) fate = escaped;
+      }
+    }
+    else if (event == scatter)
+    {
+      fate = do_scatter(&p,eps_absorb_cmf);
+      // absorbed gamma-rays carry on as optical photons
+      if (p.type != gammaray) return fate;
+    }
+    else
+      fate = stopped;
+  }
+
+  return fate;
+}
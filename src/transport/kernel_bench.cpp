@@ -0,0 +1,526 @@
+#include <mpi.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "hdf5.h"
+#include "hdf5_hl.h"
+#include "transport.h"
+#include "grid_1D_sphere.h"
+#include "grid_2D_cyln.h"
+#include "grid_3D_sphere.h"
+#include "grid_3D_cart.h"
+#include "physical_constants.h"
+#include "test_utils.h"
+
+namespace pc = physical_constants;
+
+//---------------------------------------------------------
+// Microbenchmarks of the kernels the transport spends its
+// time in: locating values on the frequency and zone grids,
+// sampling cdfs, moving between zones, opacities, solving
+// the gas state, line profiles, Compton scattering and
+// counting escaped particles into spectra.
+//
+// The inputs are synthetic but realistic: homologous supernova
+// ejecta (1.4 Msun, 1e9 cm/s, 20 days, silicon with nickel at
+// the center) written as models of each grid type, with the
+// ASD atomic data and a ~1000 bin log frequency grid.  Each kernel
+// is called over a table of precomputed random arguments, in
+// batches, until it has run for min_time.  The bytes/op of a
+// kernel count the grid and table data it reads and writes on
+// each call, so MB/s is the memory traffic it needs at that
+// speed.  Usage: kernel_bench [name filter]
+//---------------------------------------------------------
+
+const double min_time = 0.2;
+const int    n_args   = 4096;   // power of 2
+
+// results go here, so the kernels can't be optimized away
+static volatile double sink;
+static const char *filter = NULL;
+
+
+//---------------------------------------------------------
+// Time op(q) for q = 0,1,2..., in batches that grow until
+// one takes min_time, and print the time per call
+//---------------------------------------------------------
+template <class Op>
+static void bench(const char *name, double bytes_per_op, Op op)
+{
+  if ((filter)&&(!strstr(name,filter))) return;
+
+  long n = 1;
+  double secs = 0;
+  while (true)
+  {
+    double sum = 0;
+    double t0 = wall_time();
+    for (long q=0;q<n;q++) sum += op(q);
+    secs = wall_time() - t0;
+    sink = sink + sum;
+    if (secs >= min_time) break;
+    // aim a bit past min_time, growing at most 100x
+    double grow = (secs > 0) ? 1.2*min_time/secs : 100;
+    if (grow > 100) grow = 100;
+    if (grow < 2)   grow = 2;
+    n = (long)(n*grow);
+  }
+
+  double ns = 1e9*secs/n;
+  if (bytes_per_op > 0)
+    printf("  %-36s %14.1f %10.1f %12ld\n",name,ns,bytes_per_op*n/secs/1e6,n);
+  else
+    printf("  %-36s %14.1f %10s %12ld\n",name,ns,"-",n);
+  fflush(stdout);
+}
+
+
+//---------------------------------------------------------
+// The synthetic models
+//---------------------------------------------------------
+const double day      = 3600.0*24;
+const double t_model  = 20*day;
+const double v_max    = 1e9;
+const double m_ejecta = 1.4*pc::m_sun;
+const int    n_elem   = 4;
+const int    elem_Z[n_elem] = {14,26,27,28};
+const int    elem_A[n_elem] = {28,56,56,56};
+
+// the ejecta at speed v: uniform density out to v_max (and a
+// near vacuum beyond), nickel in the inner 0.5 Msun, mixed
+// out to 0.75 Msun, silicon outside
+static void ejecta(double v, double &rho, double &T, double *comp)
+{
+  double r_max = v_max*t_model;
+  double rho0  = m_ejecta/(4.0*pc::pi/3.0*r_max*r_max*r_max);
+  double m_in  = 4.0*pc::pi/3.0*pow(v*t_model,3)*rho0/pc::m_sun;
+  double x_ni  = 0;
+  if (m_in < 0.5) x_ni = 1;
+  else if (m_in < 0.75) x_ni = (0.75 - m_in)/0.25;
+
+  rho = (v < v_max) ? rho0 : 1e-10*rho0;
+  T   = 1e4;
+  comp[0] = 1 - x_ni;
+  comp[1] = 0;
+  comp[2] = 0;
+  comp[3] = x_ni;
+}
+
+// write the zone data common to all model formats, given the
+// speed of each zone
+static void write_zones(hid_t f, int rank, hsize_t *dims, const std::vector<double> &speed)
+{
+  int nz = speed.size();
+  std::vector<double> rho(nz), temp(nz), erad(nz), comp(nz*n_elem);
+  for (int i=0;i<nz;i++)
+  {
+    ejecta(speed[i],rho[i],temp[i],&comp[i*n_elem]);
+    erad[i] = pc::a*pow(temp[i],4);
+  }
+
+  hsize_t d1 = 1, de = n_elem;
+  hsize_t dc[4];
+  for (int k=0;k<rank;k++) dc[k] = dims[k];
+  dc[rank] = n_elem;
+  H5LTmake_dataset_double(f,"time",1,&d1,&t_model);
+  H5LTmake_dataset_int(f,"Z",1,&de,elem_Z);
+  H5LTmake_dataset_int(f,"A",1,&de,elem_A);
+  H5LTmake_dataset_double(f,"rho", rank,dims,&rho[0]);
+  H5LTmake_dataset_double(f,"temp",rank,dims,&temp[0]);
+  H5LTmake_dataset_double(f,"erad",rank,dims,&erad[0]);
+  H5LTmake_dataset_double(f,"comp",rank+1,dc,&comp[0]);
+}
+
+static void write_model_1D_sphere(const char *fname)
+{
+  const int n = 100;
+  double r_max = v_max*t_model, dr = r_max/n, r_min = 0;
+  std::vector<double> r_out(n), v(n);
+  for (int i=0;i<n;i++)
+  {
+    r_out[i] = (i+1)*dr;
+    v[i] = (i+0.5)*dr/t_model;
+  }
+  hid_t f = H5Fcreate(fname,H5F_ACC_TRUNC,H5P_DEFAULT,H5P_DEFAULT);
+  hsize_t dims[1] = {n}, d1 = 1;
+  write_zones(f,1,dims,v);
+  H5LTmake_dataset_double(f,"r_min",1,&d1,&r_min);
+  H5LTmake_dataset_double(f,"r_out",1,dims,&r_out[0]);
+  H5LTmake_dataset_double(f,"v",1,dims,&v[0]);
+  H5Fclose(f);
+}
+
+static void write_model_2D_cyln(const char *fname)
+{
+  const int nx = 64, nz = 128;
+  double r_max = v_max*t_model;
+  double dr[2] = {r_max/nx, 2*r_max/nz}, rmin[2] = {0, -r_max};
+  std::vector<double> speed(nx*nz), vx(nx*nz), vz(nx*nz);
+  for (int i=0;i<nx;i++)
+    for (int j=0;j<nz;j++)
+    {
+      int q = i*nz + j;
+      vx[q] = (rmin[0] + (i+0.5)*dr[0])/t_model;
+      vz[q] = (rmin[1] + (j+0.5)*dr[1])/t_model;
+      speed[q] = sqrt(vx[q]*vx[q] + vz[q]*vz[q]);
+    }
+  hid_t f = H5Fcreate(fname,H5F_ACC_TRUNC,H5P_DEFAULT,H5P_DEFAULT);
+  hsize_t dims[2] = {nx,nz}, d2 = 2;
+  write_zones(f,2,dims,speed);
+  H5LTmake_dataset_double(f,"dr",1,&d2,dr);
+  H5LTmake_dataset_double(f,"rmin",1,&d2,rmin);
+  H5LTmake_dataset_double(f,"vx",2,dims,&vx[0]);
+  H5LTmake_dataset_double(f,"vz",2,dims,&vz[0]);
+  H5Fclose(f);
+}
+
+static void write_model_3D_sphere(const char *fname)
+{
+  const int nr = 64, nt = 32, np = 32;
+  double r_max = v_max*t_model;
+  // (the spherical grid takes the inner radius only)
+  double dr[3] = {r_max/nr, pc::pi/nt, 2*pc::pi/np}, rmin = 0;
+  int n = nr*nt*np;
+  std::vector<double> speed(n), vr(n), vzero(n,0);
+  for (int i=0;i<nr;i++)
+    for (int q=0;q<nt*np;q++)
+    {
+      vr[i*nt*np + q] = (i+0.5)*dr[0]/t_model;
+      speed[i*nt*np + q] = vr[i*nt*np + q];
+    }
+  hid_t f = H5Fcreate(fname,H5F_ACC_TRUNC,H5P_DEFAULT,H5P_DEFAULT);
+  hsize_t dims[3] = {nr,nt,np}, d3 = 3, d1 = 1;
+  write_zones(f,3,dims,speed);
+  H5LTmake_dataset_double(f,"dr",1,&d3,dr);
+  H5LTmake_dataset_double(f,"rmin",1,&d1,&rmin);
+  H5LTmake_dataset_double(f,"vr",3,dims,&vr[0]);
+  H5LTmake_dataset_double(f,"vtheta",3,dims,&vzero[0]);
+  H5LTmake_dataset_double(f,"vphi",3,dims,&vzero[0]);
+  H5Fclose(f);
+}
+
+static void write_model_3D_cart(const char *fname)
+{
+  const int nx = 64;
+  double r_max = v_max*t_model, dx = 2*r_max/nx;
+  double dr[3] = {dx,dx,dx}, rmin[3] = {-r_max,-r_max,-r_max};
+  int n = nx*nx*nx;
+  std::vector<double> speed(n), vx(n), vy(n), vz(n);
+  for (int i=0;i<nx;i++)
+    for (int j=0;j<nx;j++)
+      for (int k=0;k<nx;k++)
+      {
+        int q = (i*nx + j)*nx + k;
+        vx[q] = (rmin[0] + (i+0.5)*dx)/t_model;
+        vy[q] = (rmin[1] + (j+0.5)*dx)/t_model;
+        vz[q] = (rmin[2] + (k+0.5)*dx)/t_model;
+        speed[q] = sqrt(vx[q]*vx[q] + vy[q]*vy[q] + vz[q]*vz[q]);
+      }
+  hid_t f = H5Fcreate(fname,H5F_ACC_TRUNC,H5P_DEFAULT,H5P_DEFAULT);
+  hsize_t dims[3] = {nx,nx,nx}, d3 = 3;
+  write_zones(f,3,dims,speed);
+  H5LTmake_dataset_double(f,"dr",1,&d3,dr);
+  H5LTmake_dataset_double(f,"rmin",1,&d3,rmin);
+  H5LTmake_dataset_double(f,"vx",3,dims,&vx[0]);
+  H5LTmake_dataset_double(f,"vy",3,dims,&vy[0]);
+  H5LTmake_dataset_double(f,"vz",3,dims,&vz[0]);
+  H5Fclose(f);
+}
+
+// write the parameter file for a model of the given grid type
+static void write_params(const char *pfile, const char *grid_type, const char *model_file)
+{
+  std::string home = getenv("SEDONA_HOME");
+  FILE *f = fopen(pfile,"w");
+  if (f == NULL)
+  {
+    std::cerr << "# Can't write parameter file " << pfile << "; exiting" << std::endl;
+    exit(1);
+  }
+  fprintf(f,"defaults_file    = \"%s/defaults/sedona_defaults.lua\"\n",home.c_str());
+  fprintf(f,"data_atomic_file = \"%s/data/ASD_atomdata.hdf5\"\n",home.c_str());
+  fprintf(f,"grid_type    = \"%s\"\n",grid_type);
+  fprintf(f,"model_file   = \"%s\"\n",model_file);
+  fprintf(f,"hydro_module = \"homologous\"\n");
+  fprintf(f,"transport_nu_grid = {1e14,3e16,0.005,1}\n");
+  fprintf(f,"spectrum_nu_grid  = transport_nu_grid\n");
+  fprintf(f,"opacity_grey_opacity  = 0\n");
+  fprintf(f,"opacity_atoms_in_nlte = {14}\n");
+  fprintf(f,"opacity_bound_bound   = 1\n");
+  fprintf(f,"opacity_bound_free    = 1\n");
+  fprintf(f,"opacity_free_free     = 1\n");
+  fprintf(f,"opacity_electron_scattering = 1\n");
+  fprintf(f,"line_velocity_width   = 5e7\n");
+  fclose(f);
+}
+
+
+//---------------------------------------------------------
+// locate_array and cdf_array
+//---------------------------------------------------------
+static void bench_arrays()
+{
+  const int n = 1000;
+  std::vector<double> xval(n_args);
+  double log_steps = ceil(log2((double)n))*sizeof(double);
+
+  // linear, log and irregular (flex) grids of n points
+  locate_array lin, lg, flex;
+  lin.init(1e14,1e14 + n*3e13,3e13);
+  lg.log_init(1e14,3e16,pow(300.0,1.0/n) - 1);
+  std::vector<double> xf(n);
+  double x = 1e14;
+  for (int i=0;i<n;i++) {x *= 1 + 0.01*lcg_uniform(); xf[i] = x;}
+  flex.init(xf,1e14);
+
+  for (int q=0;q<n_args;q++) xval[q] = lin.minval() + lcg_uniform()*(lin.maxval() - lin.minval());
+  bench("locate_array::locate (lin)",2*sizeof(double),
+    [&](long q) {return lin.locate_within_bounds(xval[q & (n_args-1)]);});
+
+  for (int q=0;q<n_args;q++) xval[q] = lg.minval()*pow(lg.maxval()/lg.minval(),lcg_uniform());
+  bench("locate_array::locate (log)",2*sizeof(double),
+    [&](long q) {return lg.locate_within_bounds(xval[q & (n_args-1)]);});
+
+  for (int q=0;q<n_args;q++) xval[q] = flex.minval() + lcg_uniform()*(flex.maxval() - flex.minval());
+  bench("locate_array::locate (flex)",log_steps,
+    [&](long q) {return flex.locate_within_bounds(xval[q & (n_args-1)]);});
+
+  // an emissivity-like cdf (a blackbody with lines)
+  cdf_array<double> cdf;
+  cdf.resize(n);
+  for (int i=0;i<n;i++)
+  {
+    double y = pow(i+1.0,3)*exp(-(i+1.0)/100);
+    if (lcg_uniform() < 0.1) y *= 100*lcg_uniform();
+    cdf.set_value(i,y);
+  }
+  cdf.normalize();
+  for (int q=0;q<n_args;q++) xval[q] = lcg_uniform();
+  bench("cdf_array::sample",log_steps,
+    [&](long q) {return cdf.sample(xval[q & (n_args-1)]);});
+}
+
+
+//---------------------------------------------------------
+// Zone crossing and velocities on a model of each grid type
+//---------------------------------------------------------
+static void bench_grid(const char *grid_type, grid_general *grid)
+{
+  std::string pfile = std::string("bench_") + grid_type + ".lua";
+  std::string mfile = std::string("bench_") + grid_type + ".h5";
+  if      (!strcmp(grid_type,"grid_1D_sphere")) write_model_1D_sphere(mfile.c_str());
+  else if (!strcmp(grid_type,"grid_2D_cyln"))   write_model_2D_cyln(mfile.c_str());
+  else if (!strcmp(grid_type,"grid_3D_sphere")) write_model_3D_sphere(mfile.c_str());
+  else write_model_3D_cart(mfile.c_str());
+  write_params(pfile.c_str(),grid_type,mfile.c_str());
+
+  ParameterReader params(pfile,0);
+  grid->init(&params);
+  remove(pfile.c_str());
+  remove(mfile.c_str());
+
+  // random points in the ejecta (inside the grid) and directions
+  struct arg {double x[3], D[3]; int i;};
+  std::vector<arg> args(n_args);
+  double r_max = v_max*t_model;
+  for (int q=0;q<n_args;q++)
+  {
+    arg &a = args[q];
+    do {
+      double r = 0.99*r_max*pow(lcg_uniform(),1.0/3.0);
+      random_direction(a.x);
+      for (int k=0;k<3;k++) a.x[k] *= r;
+      // the 2D grid is of the x > 0 half plane
+      if (!strcmp(grid_type,"grid_2D_cyln")) a.x[0] = fabs(a.x[0]);
+      a.i = grid->get_zone(a.x);
+    } while (a.i < 0);
+    random_direction(a.D);
+  }
+
+  std::string name = std::string("get_next_zone (") + grid_type + ")";
+  bench(name.c_str(),6*sizeof(double),[&](long q) {
+    arg &a = args[q & (n_args-1)];
+    double l;
+    int i = grid->get_next_zone(a.x,a.D,a.i,0,&l);
+    return i + l;
+  });
+
+  name = std::string("get_velocity (") + grid_type + ")";
+  bench(name.c_str(),3*sizeof(double),[&](long q) {
+    arg &a = args[q & (n_args-1)];
+    double v[3], dvds;
+    grid->get_velocity(a.i,a.x,a.D,v,&dvds);
+    return v[0] + dvds;
+  });
+}
+
+
+//---------------------------------------------------------
+// Opacities, gas state and scattering, using the transport
+// set up on the 1D model (friend of transport)
+//---------------------------------------------------------
+class kernel_bench
+{
+ public:
+
+  static void transport_kernels(grid_general *grid)
+  {
+    write_model_1D_sphere("bench_transport.h5");
+    write_params("bench_transport.lua","grid_1D_sphere","bench_transport.h5");
+    ParameterReader params("bench_transport.lua",0);
+    grid->init(&params);
+
+    transport mcarlo;
+    mcarlo.write_levels = 0;
+    mcarlo.init(&params,grid);
+    remove("bench_transport.lua");
+    remove("bench_transport.h5");
+
+    // the LTE opacities of all zones
+    mcarlo.t_now_ = grid->t_now;
+    double t0 = MPI_Wtime();
+    mcarlo.set_opacity(day);
+    mcarlo.reduce_opacities();
+    printf("# opacities of %d zones, %d frequencies in %.3f secs\n",
+      grid->n_zones,mcarlo.nu_grid_.size(),MPI_Wtime() - t0);
+    fflush(stdout);
+
+    locate_array &nu = mcarlo.nu_grid_;
+    int nz = grid->n_zones;
+    int n_nu = nu.size();
+
+    // optical photons and gamma-rays in random zones
+    std::vector<particle> photons(n_args), gammas(n_args);
+    for (int q=0;q<n_args;q++)
+    {
+      particle &p = photons[q];
+      p.type = photon;
+      p.ind  = (int)(nz*lcg_uniform());
+      p.nu   = nu.minval()*pow(nu.maxval()/nu.minval(),lcg_uniform());
+      p.e    = 1;
+      p.t    = grid->t_now;
+      grid->sample_in_zone(p.ind,std::vector<double>{lcg_uniform(),lcg_uniform(),lcg_uniform()},p.x);
+      random_direction(p.D);
+      gammas[q] = p;
+      gammas[q].type = gammaray;
+      gammas[q].nu   = 0.01*pow(500.0,lcg_uniform());
+    }
+
+    bench("transport::get_opacity",2*sizeof(OpacityType) + 2*sizeof(double),[&](long q) {
+      double opac, eps;
+      int i = mcarlo.get_opacity(photons[q & (n_args-1)],1.0,opac,eps);
+      return i + opac + eps;
+    });
+
+    bench("transport::klein_nishina",0,[&](long q) {
+      return mcarlo.klein_nishina(gammas[q & (n_args-1)].nu);
+    });
+
+    bench("transport::compton_scatter",0,[&](long q) {
+      particle p = gammas[q & (n_args-1)];
+      mcarlo.compton_scatter(&p);
+      return p.nu;
+    });
+
+    // the gas state of zones from the center to the edge
+    GasState &gas = mcarlo.gas_state_vec_[0];
+    std::vector<int> zones(8);
+    for (size_t k=0;k<zones.size();k++) zones[k] = (2*k + 1)*nz/(2*zones.size());
+    auto set_zone = [&](int i) {
+      zone &z = grid->z[i];
+      gas.dens_ = z.rho;
+      gas.temp_ = z.T_gas;
+      gas.time_ = grid->t_now;
+      gas.set_mass_fractions(z.X_gas);
+    };
+
+    // opacities of the nickel core and the silicon envelope
+    std::vector<OpacityType> abs(n_nu), scat(n_nu), emis(n_nu);
+    gas.use_nlte_ = 0;
+    set_zone(zones[0]);
+    gas.solve_state();
+    bench("GasState::computeOpacity (Ni)",3*n_nu*sizeof(OpacityType),[&](long q) {
+      gas.computeOpacity(abs,scat,emis);
+      return abs[n_nu/2];
+    });
+    set_zone(zones.back());
+    gas.solve_state();
+    bench("GasState::computeOpacity (Si)",3*n_nu*sizeof(OpacityType),[&](long q) {
+      gas.computeOpacity(abs,scat,emis);
+      return abs[n_nu/2];
+    });
+
+    bench("GasState::solve_state (LTE)",0,[&](long q) {
+      set_zone(zones[q % zones.size()]);
+      gas.solve_state();
+      return gas.n_elec_;
+    });
+
+    // NLTE silicon, in a diluted blackbody radiation field
+    std::vector<real> J_nu(n_nu);
+    for (int j=0;j<n_nu;j++) J_nu[j] = 0.1*mcarlo.blackbody_nu(1e4,nu.center(j));
+    gas.use_nlte_ = 1;
+    bench("GasState::solve_state (NLTE Si)",n_nu*sizeof(real),[&](long q) {
+      set_zone(zones[q % zones.size()]);
+      gas.solve_state(J_nu);
+      return gas.n_elec_;
+    });
+    gas.use_nlte_ = 0;
+
+    // line profiles across the core and wings
+    std::vector<double> vx(n_args), va(n_args);
+    for (int q=0;q<n_args;q++)
+    {
+      vx[q] = 10*(2*lcg_uniform() - 1);
+      va[q] = pow(10.0,-4 + 3*lcg_uniform());
+    }
+    bench("VoigtProfile::getProfile",0,[&](long q) {
+      return mcarlo.voigt_profile_.getProfile(vx[q & (n_args-1)],va[q & (n_args-1)]);
+    });
+
+    // escaping photons counted into a spectrum
+    spectrum_array spec;
+    std::vector<double> stg = {0,40*day,0.5*day};
+    std::vector<double> sng = {1e14,3e16,0.005,1};
+    spec.init(stg,sng,10,10);
+    std::vector<double> ts(n_args);
+    for (int q=0;q<n_args;q++) ts[q] = 40*day*lcg_uniform();
+    bench("spectrum_array::count",8*sizeof(double) + 2*sizeof(double),[&](long q) {
+      particle &p = photons[q & (n_args-1)];
+      spec.count(ts[q & (n_args-1)],p.nu,p.e,p.D);
+      return 0.0;
+    });
+  }
+};
+
+
+int main(int argc, char **argv)
+{
+  MPI_Init(&argc,&argv);
+  if (argc > 1) filter = argv[1];
+  if (getenv("SEDONA_HOME") == NULL)
+  {
+    std::cerr << "# SEDONA_HOME must be set to find the defaults and atomic data" << std::endl;
+    exit(1);
+  }
+
+  grid_1D_sphere g1;
+  grid_2D_cyln   g2;
+  grid_3D_sphere g3;
+  grid_3D_cart   gc;
+  grid_1D_sphere gt;
+
+  printf("# %-36s %14s %10s %12s\n","kernel","ns/op","MB/s","calls");
+  bench_arrays();
+  bench_grid("grid_1D_sphere",&g1);
+  bench_grid("grid_2D_cyln",&g2);
+  bench_grid("grid_3D_sphere",&g3);
+  bench_grid("grid_3D_cart",&gc);
+  kernel_bench::transport_kernels(&gt);
+
+  MPI_Finalize();
+  return 0;
+}
@@ -0,0 +1,130 @@
+//------------------------------------------------------------
+// node_shared.cpp
+// This file contains the functions that (optionally) keep the
+// zone opacity and emissivity arrays in MPI-3 shared memory,
+// so that all ranks on a node use one copy of them rather
+// than one copy each.  Every rank writes only the rows of its
+// own zones, and the first rank on each node writes the rows
+// received from other nodes
+//------------------------------------------------------------
+
+#include <iostream>
+#include "transport.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+
+
+#ifdef MPI_PARALLEL
+//------------------------------------------------------------
+// allocate n values of type T shared by all ranks of comm,
+// returning a pointer to the start of the segment
+//------------------------------------------------------------
+template <class T>
+static T* allocate_node_shared(size_t n, int node_rank, MPI_Comm comm, MPI_Win &win)
+{
+  // the first rank on the node holds the whole segment
+  MPI_Aint size = (node_rank == 0) ? n*sizeof(T) : 0;
+  T *base;
+  MPI_Win_allocate_shared(size,sizeof(T),MPI_INFO_NULL,comm,&base,&win);
+
+  MPI_Aint seg_size;
+  int disp_unit;
+  MPI_Win_shared_query(win,0,&seg_size,&disp_unit,&base);
+
+  // ranks access the memory directly, synchronizing with
+  // MPI_Win_sync and barriers on the node
+  MPI_Win_lock_all(MPI_MODE_NOCHECK,win);
+  return base;
+}
+#endif
+
+
+//------------------------------------------------------------
+// Set up the communicator of ranks on my node, and find my
+// rank on it and the node of each rank.  Called before the
+// memory of the opacities is accounted, which is charged to
+// the first rank of each node
+//------------------------------------------------------------
+void transport::setup_node_comm()
+{
+#ifdef MPI_PARALLEL
+  MPI_Comm_split_type(MPI_COMM_WORLD,MPI_COMM_TYPE_SHARED,MPI_myID,
+    MPI_INFO_NULL,&node_comm_);
+  MPI_Comm_rank(node_comm_,&node_rank_);
+
+  // label each node by the world rank of its first rank
+  int node_id = MPI_myID;
+  MPI_Bcast(&node_id,1,MPI_INT,0,node_comm_);
+  rank_node_.resize(MPI_nprocs);
+  MPI_Allgather(&node_id,1,MPI_INT,&rank_node_[0],1,MPI_INT,MPI_COMM_WORLD);
+#endif
+}
+
+
+//------------------------------------------------------------
+// Put the opacity and emissivity arrays in memory shared by
+// the ranks on my node (after setup_node_comm)
+//------------------------------------------------------------
+void transport::setup_node_shared_opacities()
+{
+#ifdef MPI_PARALLEL
+  int node_size;
+  MPI_Comm_size(node_comm_,&node_size);
+
+  int nz = grid->n_zones;
+  int nw = nu_grid_.size();
+  node_windows_.resize(3);
+  abs_opacity_.attach(allocate_node_shared<OpacityType>((size_t)nz*nw,
+    node_rank_,node_comm_,node_windows_[0]),nz,nw);
+  emissivity_.attach(allocate_node_shared<OpacityType>((size_t)nz*nw,
+    node_rank_,node_comm_,node_windows_[1]),nz,nw);
+  if (!omit_scattering_)
+    scat_opacity_.attach(allocate_node_shared<OpacityType>((size_t)nz*nw,
+      node_rank_,node_comm_,node_windows_[2]),nz,nw);
+  else
+    node_windows_.resize(2);
+
+  if (verbose)
+    cout << "# Opacities are in node-shared memory (" << node_size <<
+      " ranks on node 0)\n";
+#endif
+}
+
+
+//------------------------------------------------------------
+// Free the node-shared memory (must be called before
+// MPI_Finalize)
+//------------------------------------------------------------
+void transport::free_node_shared_opacities()
+{
+#ifdef MPI_PARALLEL
+  if (!node_shared_) return;
+  for (size_t w=0;w<node_windows_.size();w++)
+  {
+    MPI_Win_unlock_all(node_windows_[w]);
+    MPI_Win_free(&node_windows_[w]);
+  }
+  node_windows_.clear();
+  MPI_Comm_free(&node_comm_);
+  node_shared_ = 0;
+#endif
+}
+
+
+//------------------------------------------------------------
+// Make all writes to the node-shared arrays visible to the
+// other ranks on my node, and wait until they have done the
+// same.  Called after the arrays are filled in, and before
+// they are changed again
+//------------------------------------------------------------
+void transport::node_barrier()
+{
+#ifdef MPI_PARALLEL
+  if (!node_shared_) return;
+  for (size_t w=0;w<node_windows_.size();w++) MPI_Win_sync(node_windows_[w]);
+  MPI_Barrier(node_comm_);
+  for (size_t w=0;w<node_windows_.size();w++) MPI_Win_sync(node_windows_[w]);
+#endif
+}
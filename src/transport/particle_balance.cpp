@@ -0,0 +1,208 @@
+//------------------------------------------------------------
+// particle_balance.cpp
+// This file contains the (optional) balancing of the particle
+// work among the MPI ranks.  Before propagating, each rank
+// estimates the work of its particles from the mean number of
+// events of particles that started in the same zone last step,
+// and ranks with more than the mean send particles to those
+// with less.  Every rank's particles carry the full energy
+// normalization, so particles can be moved freely between them
+//------------------------------------------------------------
+
+#include <iostream>
+#include <algorithm>
+#include "transport.h"
+
+using std::cout;
+
+// message tag used for balancing particles
+#define BALANCE_TAG 3102
+
+
+//------------------------------------------------------------
+// allocate the event counters of each thread, and (if
+// balancing) the tallies of particle costs
+//------------------------------------------------------------
+void transport::setup_particle_balance()
+{
+#ifdef _OPENMP
+  int max_nthreads = omp_get_max_threads();
+#else
+  int max_nthreads = 1;
+#endif
+  n_events_thread_.assign(8*max_nthreads,0);
+
+  if (!particle_balance_) return;
+  int nz = grid->n_zones;
+  particle_cost_.assign(nz,1);
+  cost_events_thread_.assign(max_nthreads*nz,0);
+  cost_count_thread_.assign(max_nthreads*nz,0);
+}
+
+
+//------------------------------------------------------------
+// Tally the n events of a particle that started in zone i
+// into the buffer of this thread
+//------------------------------------------------------------
+void transport::tally_particle_cost(int i, long n)
+{
+#ifdef _OPENMP
+  int my_threadID = omp_get_thread_num();
+#else
+  int my_threadID = 0;
+#endif
+  int nz = grid->n_zones;
+  cost_events_thread_[my_threadID*nz + i] += n;
+  cost_count_thread_[my_threadID*nz + i]  += 1;
+}
+
+
+//------------------------------------------------------------
+// Combine the tallies of all threads and ranks into the mean
+// events per particle in each zone, and clear them. Zones that
+// had no particles get the mean over all particles
+//------------------------------------------------------------
+void transport::reduce_particle_costs()
+{
+#ifdef MPI_PARALLEL
+  int nz = grid->n_zones;
+  int nt = cost_events_thread_.size()/nz;
+
+  vector<double> send(2*nz,0), recv(2*nz,0);
+  for (int t=0;t<nt;t++)
+    for (int i=0;i<nz;i++)
+    {
+      send[i]      += cost_events_thread_[t*nz + i];
+      send[nz + i] += cost_count_thread_[t*nz + i];
+      cost_events_thread_[t*nz + i] = 0;
+      cost_count_thread_[t*nz + i]  = 0;
+    }
+  MPI_Allreduce(&send[0],&recv[0],2*nz,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+
+  double n_events = 0, n_particles = 0;
+  for (int i=0;i<nz;i++)
+  {
+    n_events    += recv[i];
+    n_particles += recv[nz + i];
+  }
+  // nothing was propagated yet; keep the old estimates
+  if (n_particles == 0) return;
+
+  double mean_cost = n_events/n_particles;
+  for (int i=0;i<nz;i++)
+  {
+    if (recv[nz + i] > 0) particle_cost_[i] = recv[i]/recv[nz + i];
+    else particle_cost_[i] = mean_cost;
+  }
+#endif
+}
+
+
+//------------------------------------------------------------
+// estimated work (events) of propagating particle p
+//------------------------------------------------------------
+double transport::particle_cost(const particle &p) const
+{
+  int i = p.ind;
+  if ((i < 0)||(i >= grid->n_zones)) return 1;
+  return particle_cost_[i];
+}
+
+
+//------------------------------------------------------------
+// Move particles among the ranks so that each has about the
+// same estimated work.  The transfers are planned the same way
+// on every rank, pairing ranks above the mean work with ranks
+// below it in rank order.  Senders give up particles from the
+// back of their list (the newly emitted ones)
+//------------------------------------------------------------
+void transport::balance_particles()
+{
+  phase_timer timer("balance_particles");
+#ifdef MPI_PARALLEL
+  if (!particle_balance_) return;
+
+  reduce_particle_costs();
+
+  // estimated work of each rank
+  double my_work = 0;
+  for (size_t q=0;q<particles.size();q++) my_work += particle_cost(particles[q]);
+  vector<double> work(MPI_nprocs);
+  MPI_Allgather(&my_work,1,MPI_DOUBLE,&work[0],1,MPI_DOUBLE,MPI_COMM_WORLD);
+
+  double total = 0;
+  int p_max = 0;
+  for (int p=0;p<MPI_nprocs;p++)
+  {
+    total += work[p];
+    if (work[p] > work[p_max]) p_max = p;
+  }
+  if (total <= 0) return;
+  double mean = total/MPI_nprocs;
+  double imbalance = work[p_max]/mean;
+
+  if (verbose)
+    cout << "# Particle work imbalance (max/mean rank events) = " << imbalance <<
+      " (rank " << p_max << ")\n";
+  if (imbalance < particle_balance_tolerance_) return;
+
+  // plan the transfers: each pairing zeroes the excess of the
+  // sender or the deficit of the receiver
+  vector<double> excess(MPI_nprocs);
+  for (int p=0;p<MPI_nprocs;p++) excess[p] = work[p] - mean;
+  vector<int> send_to, recv_from;
+  vector<double> send_work;
+  int d = 0, r = 0;
+  while (true)
+  {
+    while ((d < MPI_nprocs)&&(excess[d] <= 0)) d++;
+    while ((r < MPI_nprocs)&&(excess[r] >= 0)) r++;
+    if ((d == MPI_nprocs)||(r == MPI_nprocs)) break;
+    double amount = std::min(excess[d],-excess[r]);
+    if (d == MPI_myID) {send_to.push_back(r); send_work.push_back(amount);}
+    if (r == MPI_myID) recv_from.push_back(d);
+    excess[d] -= amount;
+    excess[r] += amount;
+  }
+
+  // send off particles worth about the planned work
+  vector< vector<particle> > outgoing(send_to.size());
+  vector<MPI_Request> requests(send_to.size());
+  long n_sent = 0;
+  for (size_t k=0;k<send_to.size();k++)
+  {
+    double sent = 0;
+    while (!particles.empty())
+    {
+      double c = particle_cost(particles.back());
+      if (sent + 0.5*c > send_work[k]) break;
+      outgoing[k].push_back(particles.back());
+      particles.pop_back();
+      sent += c;
+    }
+    particle *buf = outgoing[k].empty() ? NULL : &outgoing[k][0];
+    MPI_Isend(buf,outgoing[k].size(),MPI_particle,send_to[k],
+      BALANCE_TAG,MPI_COMM_WORLD,&requests[k]);
+    n_sent += outgoing[k].size();
+  }
+
+  // and receive the particles sent to me
+  for (size_t k=0;k<recv_from.size();k++)
+  {
+    MPI_Status status;
+    MPI_Probe(recv_from[k],BALANCE_TAG,MPI_COMM_WORLD,&status);
+    int n_new;
+    MPI_Get_count(&status,MPI_particle,&n_new);
+    size_t n0 = particles.size();
+    particles.resize(n0 + n_new);
+    particle *buf = (n_new > 0) ? &particles[n0] : NULL;
+    MPI_Recv(buf,n_new,MPI_particle,recv_from[k],BALANCE_TAG,MPI_COMM_WORLD,
+      MPI_STATUS_IGNORE);
+  }
+  if (!requests.empty())
+    MPI_Waitall(requests.size(),&requests[0],MPI_STATUSES_IGNORE);
+
+  if (verbose)
+    cout << "# Balanced particles (" << n_sent << " sent from rank 0)\n";
+#endif
+}
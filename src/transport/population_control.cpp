@@ -0,0 +1,171 @@
+//------------------------------------------------------------
+// population_control.cpp
+// This file contains functions that control the number of
+// census particles carried over from one time step to the next
+//------------------------------------------------------------
+
+#include <math.h>
+#include <vector>
+#include "transport.h"
+#include "physical_constants.h"
+
+namespace pc = physical_constants;
+using std::cout;
+using std::endl;
+
+
+//------------------------------------------------------------
+// return the population control group of a census particle.
+// optical photons are split into comb_n_bands_ frequency
+// bands (equal numbers of nu_grid bins); each other type
+// (gamma-rays, positrons, neutrinos) has a group of its own
+// after those, for comb_n_groups() groups in all
+//------------------------------------------------------------
+int transport::comb_n_groups() const
+{
+  return comb_n_bands_ + neutrino;
+}
+
+int transport::comb_group(const particle &p) const
+{
+  if (p.type != photon) return comb_n_bands_ + p.type - 1;
+  if (comb_n_bands_ == 1) return 0;
+
+  int n_nu = nu_grid_.size();
+  int i_nu = nu_grid_.locate_within_bounds(p.nu);
+  if (i_nu >= n_nu) i_nu = n_nu - 1;
+  return (i_nu*comb_n_bands_)/n_nu;
+}
+
+
+//------------------------------------------------------------
+// Population control of the particles that remain on the
+// grid at the end of a time step. Zones that hold too many
+// (or too few) particles are resampled with a comb, such
+// that each zone ends up with ~comb_n_per_zone_ particles
+// of equal energy. The energy in each zone is conserved
+// exactly, separately for each frequency band and type.
+// Reference: Szoke & Brooks, JQSRT 91, 95 (2005)
+//------------------------------------------------------------
+void transport::comb_particles()
+{
+  phase_timer timer("comb");
+  if (comb_n_per_zone_ <= 0) return;
+  if (particles.size() == 0) return;
+
+  int nz       = grid->n_zones;
+  int n_groups = comb_n_groups();
+
+  // target number of particles per zone on this rank
+  int n_target = ceil(comb_n_per_zone_/(1.0*MPI_nprocs));
+  if (n_target < 1) n_target = 1;
+  double n_hi = n_target*comb_tolerance_;
+  double n_lo = n_target/comb_tolerance_;
+
+  // count particles in each zone
+  vector<int> zone_count(nz,0);
+  for (size_t q=0;q<particles.size();q++)
+    if (particles[q].ind >= 0) zone_count[particles[q].ind]++;
+
+  // flag zones whose population is outside the allowed range
+  // don't bother splitting if we can't afford the space
+  vector<char> do_comb(nz,0);
+  int n_comb_zones = 0;
+  long n_split_add = 0;
+  for (int i=0;i<nz;i++)
+  {
+    if (zone_count[i] == 0) continue;
+    if (zone_count[i] > n_hi) do_comb[i] = 1;
+    else if (zone_count[i] < n_lo)
+    {
+      do_comb[i] = 1;
+      n_split_add += n_target - zone_count[i];
+    }
+    n_comb_zones += do_comb[i];
+  }
+  if ((long)particles.size() + n_split_add > max_total_particles)
+    for (int i=0;i<nz;i++)
+      if ((do_comb[i])&&(zone_count[i] > 0)&&(zone_count[i] < n_lo))
+        {do_comb[i] = 0; n_comb_zones--;}
+  if (n_comb_zones == 0) return;
+
+  // bucket the particles in flagged zones by (zone,group),
+  // keeping the ones in all other zones where they are
+  vector<int> offset(nz*n_groups+1,0);
+  vector<double> E_group(nz*n_groups,0);
+  vector<double> E_zone(nz,0);
+  for (size_t q=0;q<particles.size();q++)
+  {
+    int i = particles[q].ind;
+    if ((i < 0)||(!do_comb[i])) continue;
+    int g = i*n_groups + comb_group(particles[q]);
+    offset[g+1]++;
+    E_group[g] += particles[q].e;
+    E_zone[i]  += particles[q].e;
+  }
+  for (int g=0;g<nz*n_groups;g++) offset[g+1] += offset[g];
+
+  std::vector<particle> pool(offset.back());
+  vector<int> fill(offset.begin(),offset.end()-1);
+  size_t n_keep = 0;
+  for (size_t q=0;q<particles.size();q++)
+  {
+    int i = particles[q].ind;
+    if ((i >= 0)&&(do_comb[i]))
+      pool[fill[i*n_groups + comb_group(particles[q])]++] = particles[q];
+    else
+      particles[n_keep++] = particles[q];
+  }
+
+  // comb each group down (or up) to its share of the target
+  std::vector<particle> combed;
+  combed.reserve(n_comb_zones*(size_t)(n_target + n_groups));
+  for (int i=0;i<nz;i++)
+  {
+    if (!do_comb[i]) continue;
+    for (int k=0;k<n_groups;k++)
+    {
+      int g = i*n_groups + k;
+      if (offset[g+1] == offset[g]) continue;
+      if (E_group[g] <= 0) continue;
+
+      // number of teeth, proportional to the energy in the group
+      int n_teeth = floor(n_target*E_group[g]/E_zone[i] + 0.5);
+      if (n_teeth < 1) n_teeth = 1;
+      double E_tooth = E_group[g]/n_teeth;
+
+      // lay down the comb with a random offset; a particle gets
+      // one copy for every tooth that falls within its energy
+      double tooth = E_tooth*rangen.uniform();
+      double E_sum = 0;
+      int n_made = 0;
+      for (int j=offset[g];j<offset[g+1];j++)
+      {
+        particle &p = pool[j];
+        E_sum += p.e;
+        while ((tooth < E_sum)&&(n_made < n_teeth))
+        {
+          combed.push_back(p);
+          combed.back().e = E_tooth;
+          tooth += E_tooth;
+          n_made++;
+        }
+      }
+      // guard against roundoff at the end of the comb
+      while (n_made < n_teeth)
+      {
+        combed.push_back(pool[offset[g+1]-1]);
+        combed.back().e = E_tooth;
+        n_made++;
+      }
+    }
+  }
+
+  int n_before = particles.size();
+  particles.resize(n_keep);
+  particles.insert(particles.end(),combed.begin(),combed.end());
+
+  if (verbose)
+    cout << "# Combed census particles in " << n_comb_zones << " zones (" <<
+      n_before << " -> " << particles.size() << " particles on rank 0)\n";
+}
@@ -2,6 +2,7 @@
 #include <gsl/gsl_rng.h>
 #include <cassert>
 #include "transport.h"
+#include "compton_sampler.h"
 #include "physical_constants.h"
 
 namespace pc = physical_constants;
@@ -13,6 +14,7 @@ ParticleFate transport::do_scatter(particle *p, double eps)
 {
   zone *zone = &(grid->z[p->ind]);
   ParticleFate fate = moving;
+  count_zone_event(p->ind,zev_scatter);
 
   // Update position of last interaction
   p->x_interact[0] = p->x[0];
@@ -49,7 +51,7 @@ ParticleFate transport::do_scatter(particle *p, double eps)
     // or if absorbed, turn it into a photon
     else
     {
-      grid->z[p->ind].L_radio_dep += p->e;
+      deposit_gamma(p->ind,p->e);
       p->type = photon;
       // isotropic emission in comoving frame
       double mu  = 1 - 2.0*rangen.uniform();
@@ -79,28 +81,19 @@ void transport::compton_scatter(particle *p)
 
   transform_lab_to_comoving(p);
 
-  // sample new direction by rejection method
   double E_ratio;
   double D_new[3];
-  while (true)
-  {
-    // isotropic new direction
-    double mu  = 1 - 2.0*rangen.uniform();
-    double phi = 2.0*pc::pi*rangen.uniform();
-    double smu = sqrt(1 - mu*mu);
-    D_new[0] = smu*cos(phi);
-    D_new[1] = smu*sin(phi);
-    D_new[2] = mu;
 
-    // angle between old and new directions
-    double cost = p->D[0]*D_new[0] + p->D[1]*D_new[1] + p->D[2]*D_new[2];
-    // new energy ratio (E_new/E_old) at this angle (assuming lambda in MeV)
-    E_ratio = 1/(1 + p->nu/pc::m_e_MeV*(1 - cost));
-    // klein-nishina differential cross-section
-    double diff_cs = 0.5*(E_ratio*E_ratio*(1/E_ratio + E_ratio - 1 + cost*cost));
-    // see if this scatter angle OK
-    if (rangen.uniform() < diff_cs) break;
+  // sample new direction directly with Kahn's method
+  if (compton_direct_sampling_)
+  {
+    double cost = kn_sample_kahn(p->nu/pc::m_e_MeV,rangen,E_ratio);
+    rotate_direction(p->D,cost,2.0*pc::pi*rangen.uniform(),D_new);
   }
+  // or sample new direction by rejection method
+  // (assuming lambda in MeV)
+  else
+    kn_sample_rejection(p->D,p->nu/pc::m_e_MeV,rangen,D_new,E_ratio);
 
   // new frequency
   p->nu = p->nu*E_ratio;
@@ -111,7 +104,7 @@ void transport::compton_scatter(particle *p)
   // sample whether we stay alive, if not become a photon
   if (rangen.uniform() > E_ratio)
   {
-    grid->z[p->ind].L_radio_dep += p->e;
+    deposit_gamma(p->ind,p->e);
     p->type = photon;
     // isotropic emission in comoving frame
     double mu  = 1 - 2.0*rangen.uniform();
@@ -135,34 +128,29 @@ void transport::compton_scatter(particle *p)
 
 void transport::sample_MB_vector(double T, double* v_e, double* p_d)
 {
-
-  while (true)
+  // sample the speed from the tabulated distribution, and the angle
+  // to the photon direction from the inverse of its CDF
+  if (compton_direct_sampling_)
   {
-
-    // if you prefer, you could also rejection sample to get v_tot.
-
     double v_tot = sqrt(2. * pc::k * T /pc::m_e) * mb_dv * (mb_cdf_.sample(rangen.uniform()) + rangen.uniform() );
-
-    double mu  = 1. - 2.0*rangen.uniform();
-    double phi = 2.0*pc::pi*rangen.uniform();
-    double smu = sqrt(1 - mu*mu);
-    double ed0 = smu*cos(phi);
-    double ed1 = smu*sin(phi);
-    double ed2 = mu;
-
-
-    double omega = ed0 * p_d[0] + ed1 * p_d[1] + ed2 * p_d[2];
-
-    // could tighten this bound if you think you know how small v_tot/C will be
-    if (rangen.uniform() < 0.5 * (1. - omega * v_tot/pc::c)) // this is crucial. For the more relativistic case, the formula gets more complicated. See the discussion at the top of pdf page 135 (journal page 323) of the Pozdnyakov 1983 paper, which references a formula for sigma-hat four pages earlier
-    {
-
-      v_e[0] = v_tot * ed0;
-      v_e[1] = v_tot * ed1;
-      v_e[2] = v_tot * ed2;
-      return;
-    }
+    double omega = mb_sample_cosine(v_tot/pc::c,rangen);
+    double ed[3];
+    rotate_direction(p_d,omega,2.0*pc::pi*rangen.uniform(),ed);
+    v_e[0] = v_tot * ed[0];
+    v_e[1] = v_tot * ed[1];
+    v_e[2] = v_tot * ed[2];
+    return;
   }
+
+  // if you prefer, you could also rejection sample to get v_tot.
+  // the acceptance 0.5*(1 - omega*v_tot/c) is crucial. For the more relativistic case, the formula gets more complicated. See the discussion at the top of pdf page 135 (journal page 323) of the Pozdnyakov 1983 paper, which references a formula for sigma-hat four pages earlier
+  double ed[3];
+  double v_tot = mb_sample_rejection(p_d,
+    [&]() {return sqrt(2. * pc::k * T /pc::m_e) * mb_dv * (mb_cdf_.sample(rangen.uniform()) + rangen.uniform() );},
+    pc::c,rangen,ed);
+  v_e[0] = v_tot * ed[0];
+  v_e[1] = v_tot * ed[1];
+  v_e[2] = v_tot * ed[2];
 }
 
 
@@ -205,28 +193,21 @@ void transport::compton_scatter_photon(particle *p)
   p->D[2] = 1.0/dshift_into_scatterer * (p->D[2] - gamma*v_sc[2]/pc::c * (1. - gamma*vdd/pc::c/(gamma+1)) );
 
 
-  // sample new direction by rejection method
   double E_ratio;
   double D_new[3];
 
-  while (true)
+  // sample new direction directly with Kahn's method
+  if (compton_direct_sampling_)
   {
-    // isotropic new direction
-    double mu  = 1. - 2.0*rangen.uniform();
-    double phi = 2.0*pc::pi*rangen.uniform();
-    double smu = sqrt(1. - mu*mu);
-    D_new[0] = smu*cos(phi);
-    D_new[1] = smu*sin(phi);
-    D_new[2] = mu;
-
-    // angle between old and new directions
-    double cost = p->D[0]*D_new[0] + p->D[1]*D_new[1] + p->D[2]*D_new[2];
-    // new energy ratio (E_new/E_old) at this angle (assuming lambda in MeV)
-    E_ratio = 1./(1. + pc::h * p->nu / (pc::m_e_MeV * pc:: Mev_to_ergs)*(1. - cost));
-    // klein-nishina differential cross-section
-    double diff_cs = 0.5*(E_ratio*E_ratio*(1./E_ratio + E_ratio - 1. + cost*cost));
-    // see if this scatter angle OK
-    if (rangen.uniform() < diff_cs) break;
+    double k = pc::h * p->nu / (pc::m_e_MeV * pc:: Mev_to_ergs);
+    double cost = kn_sample_kahn(k,rangen,E_ratio);
+    rotate_direction(p->D,cost,2.0*pc::pi*rangen.uniform(),D_new);
+  }
+  // or sample new direction by rejection method
+  else
+  {
+    double k = pc::h * p->nu / (pc::m_e_MeV * pc:: Mev_to_ergs);
+    kn_sample_rejection(p->D,k,rangen,D_new,E_ratio);
   }
 
   // new frequency
@@ -16,6 +16,7 @@ int transport::solve_state_and_temperature(GasState* gas_state_ptr, int i)
 
   vector<OpacityType> emis(nu_grid_.size());
   vector<OpacityType> scat(nu_grid_.size());
+  vector<OpacityType> abs(nu_grid_.size());
   emis.assign(emis.size(),0.0);
 
   int solve_error = 0;
@@ -37,7 +38,8 @@ int transport::solve_state_and_temperature(GasState* gas_state_ptr, int i)
     if (gas_state_ptr->use_nlte_ == 0)
     {
       solve_error = gas_state_ptr->solve_state();
-      gas_state_ptr->computeOpacity(abs_opacity_[i],scat,emis);
+      gas_state_ptr->computeOpacity(abs,scat,emis);
+      abs_opacity_.set_row(i,abs);
     }
 
     // Calculate equilibrium temperature.
@@ -65,6 +67,7 @@ int transport::solve_state_and_temperature(GasState* gas_state_ptr, int i)
 
 void transport::solve_eq_temperature()
 {
+  phase_timer timer("temperature");
   int solve_error = 0;
   GasState* gas_state_ptr = &(gas_state_vec_[0]);
 #pragma omp parallel for schedule(dynamic, 16) default(none) firstprivate(gas_state_ptr, solve_error)
@@ -121,13 +124,15 @@ double transport::rad_eq_function_LTE(GasState* gas_state_ptr, int c,double T, i
   // helper variables need for call (will not be used)
   vector<OpacityType> emis(nu_grid_.size());
   vector<OpacityType> scat(nu_grid_.size());
+  vector<OpacityType> abs(nu_grid_.size());
   emis.assign(emis.size(),0.0);
 
   // recalculate opacities based on current T if desired
   if (solve_flag)
   {
     // solve_error = gas_state_ptr->solve_state();
-    gas_state_ptr->computeOpacity(abs_opacity_[c],scat,emis);
+    gas_state_ptr->computeOpacity(abs,scat,emis);
+    abs_opacity_.set_row(c,abs);
   }
 
   // total energy emitted (to be calculated)
@@ -13,6 +13,9 @@
 #ifdef MPI_PARALLEL
 #include <mpi.h>
 #endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using std::vector;
 namespace pc = physical_constants;
@@ -23,6 +26,9 @@ namespace pc = physical_constants;
 spectrum_array::spectrum_array()
 {
   strcpy(name,DEFAULT_NAME);
+  n_thread_copies_ = 0;
+  thread_private_  = 0;
+  copy_stride_     = 0;
 }
 
 void spectrum_array::set_name(std::string n)
@@ -82,7 +88,39 @@ void spectrum_array::init(std::vector<double> t, std::vector<double> w,
   wipe();
 }
 
+//--------------------------------------------------------------
+// Allocate copies of the counting arrays for the threads to
+// count into, using at most max_mb megabytes.  If there is
+// room for one copy per thread, threads count without
+// atomics; if only for fewer, threads share them; if for
+// less than two, all threads count (atomically) straight
+// into flux and click
+//--------------------------------------------------------------
+void spectrum_array::setup_thread_copies(double max_mb)
+{
+#ifdef _OPENMP
+  int n_threads = omp_get_max_threads();
+#else
+  int n_threads = 1;
+#endif
+
+  // pad each copy to a whole number of cache lines, so
+  // threads don't share lines at the copy edges
+  copy_stride_ = ((n_elements + 7)/8)*8;
+  double copy_mb = 2.0*copy_stride_*sizeof(double)/(1024.0*1024.0);
+
+  int n_copies = n_threads;
+  if (n_copies*copy_mb > max_mb) n_copies = (int)(max_mb/copy_mb);
+  if (n_copies < 2) n_copies = 0;
+
+  n_thread_copies_ = n_copies;
+  thread_private_  = ((n_copies > 0)&&(n_copies == n_threads));
+  thread_flux_.assign(n_copies*copy_stride_,0);
+  thread_click_.assign(n_copies*copy_stride_,0);
+}
+
 void spectrum_array::writeCheckpointSpectrum(std::string fname, std::string spectrum_name) {
+  merge_thread_copies();
   MPI_average();
   MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
   MPI_Comm_size(MPI_COMM_WORLD, &nproc);
@@ -93,8 +131,8 @@ void spectrum_array::writeCheckpointSpectrum(std::string fname, std::string spec
     mu_grid.writeCheckpoint(fname, spectrum_name, "mu_grid");
     phi_grid.writeCheckpoint(fname, spectrum_name, "phi_grid");
 
-    writeVector(fname, spectrum_name, "flux", flux, H5T_NATIVE_DOUBLE);
-    writeVector(fname, spectrum_name, "click", click, H5T_NATIVE_DOUBLE);
+    writeVector(fname, spectrum_name, "flux", output_flux(), H5T_NATIVE_DOUBLE);
+    writeVector(fname, spectrum_name, "click", output_click(), H5T_NATIVE_DOUBLE);
 
     hsize_t single_val = 1;
     hsize_t name_len = 1000;
@@ -110,6 +148,7 @@ void spectrum_array::writeCheckpointSpectrum(std::string fname, std::string spec
     createDataset(fname, spectrum_name, "a3", 1, &single_val, H5T_NATIVE_INT);
     writeSimple(fname, spectrum_name, "a3", &a3, H5T_NATIVE_INT);
   }
+  free_average();
   MPI_Barrier(MPI_COMM_WORLD);
 }
 
@@ -136,6 +175,8 @@ void spectrum_array::readCheckpointSpectrum(std::string fname, std::string n) {
 }
 
 bool spectrum_array::is_equal(spectrum_array sa, bool complain) {
+  merge_thread_copies();
+  sa.merge_thread_copies();
   bool equal = true;
   if (not time_grid.is_equal(sa.time_grid, complain)) {
     if (complain) std::cerr << "spectrum array time grids are different" << std::endl;
@@ -190,11 +231,47 @@ bool spectrum_array::is_equal(spectrum_array sa, bool complain) {
 //--------------------------------------------------------------
 void spectrum_array::wipe()
 {
-  for (size_t i=0;i<click.size();i++)
+  int n = click.size();
+  #pragma omp parallel for schedule(static)
+  for (int i=0;i<n;i++)
   {
     flux[i]   = 0;
     click[i]  = 0;
   }
+  int n_copy = thread_click_.size();
+  #pragma omp parallel for schedule(static)
+  for (int i=0;i<n_copy;i++)
+  {
+    thread_flux_[i]  = 0;
+    thread_click_[i] = 0;
+  }
+}
+
+
+//--------------------------------------------------------------
+// add the thread copies of the counting arrays into flux
+// and click, and clear them.  Must be called from outside
+// of any parallel region
+//--------------------------------------------------------------
+void spectrum_array::merge_thread_copies()
+{
+  if (n_thread_copies_ == 0) return;
+
+  #pragma omp parallel for
+  for (int i=0;i<n_elements;i++)
+  {
+    double f = 0, c = 0;
+    for (int n=0;n<n_thread_copies_;n++)
+    {
+      size_t k = n*copy_stride_ + i;
+      f += thread_flux_[k];
+      c += thread_click_[k];
+      thread_flux_[k]  = 0;
+      thread_click_[k] = 0;
+    }
+    flux[i]  += f;
+    click[i] += c;
+  }
 }
 
 
@@ -239,6 +316,34 @@ void spectrum_array::count(double t, double w, double E, double *D)
   // add to counters
   int ind      = index(t_bin,l_bin,m_bin,p_bin);
 
+  // count into this thread's copy, if we have them
+  if (n_thread_copies_ > 0)
+  {
+    // (a team larger than when the copies were set up shares
+    // them, so must count atomically)
+#ifdef _OPENMP
+    int my_threadID = omp_get_thread_num();
+    int is_private  = (thread_private_)&&(omp_get_num_threads() <= n_thread_copies_);
+#else
+    int my_threadID = 0;
+    int is_private  = thread_private_;
+#endif
+    size_t k = (my_threadID % n_thread_copies_)*copy_stride_ + ind;
+    if (is_private)
+    {
+      thread_flux_[k]  += E;
+      thread_click_[k] += 1;
+    }
+    else
+    {
+#pragma omp atomic
+      thread_flux_[k]  += E;
+#pragma omp atomic
+      thread_click_[k] += 1;
+    }
+    return;
+  }
+
 #pragma omp atomic
   flux[ind]  += E;
 #pragma omp atomic
@@ -262,8 +367,11 @@ void spectrum_array::print(int suppress_txt = 0)
   int n_mu     = this->mu_grid.size();
   int n_phi    = this->phi_grid.size();
 
+  merge_thread_copies();
   double *darray = new double[n_elements];
   double *click_buffer = new double[n_elements];
+  const std::vector<double>& flux  = output_flux();
+  const std::vector<double>& click = output_click();
 
   // unitize
   for (int k=0;k<n_mu;k++)
@@ -407,12 +515,14 @@ void spectrum_array::print(int suppress_txt = 0)
   delete[] click_buffer;
 
   H5Fclose (file_id);
+  free_average();
 
 }
 
 
 void  spectrum_array::rescale(double r)
 {
+  merge_thread_copies();
   for (size_t i=0;i<flux.size();i++) flux[i] *= r;
 }
 
@@ -421,43 +531,86 @@ void  spectrum_array::rescale(double r)
 //--------------------------------------------------------------
 // MPI average the spectrum contents
 //--------------------------------------------------------------
-// only process 0 gets the reduced spectrum to print
+// Only process 0 gets the averaged spectrum to print, which is
+// kept apart from its own counts (so every rank can keep
+// counting into its own arrays).  Only the time slices with
+// counts on some rank are reduced
 void spectrum_array::MPI_average()
 {
 #ifdef MPI_PARALLEL
 
   int receiving_ID = 0;
   int mpi_procs, myID;
+  MPI_Comm_size( MPI_COMM_WORLD, &mpi_procs );
+  MPI_Comm_rank( MPI_COMM_WORLD, &myID      );
 
-  // average the flux (receive goes out of scope after section)
-  {
-    vector<double> receive;
-    receive.resize(n_elements);
-    for (int i=0;i<n_elements;++i) receive[i] = 0.0;
+  free_average();
+  merge_thread_copies();
+  if (mpi_procs == 1) return;
 
-    //    MPI_Reduce(&flux.front(), &receive.front(), n_elements, MPI_DOUBLE, MPI_SUM, receiving_ID, MPI_COMM_WORLD);
-    MPI_Allreduce(&flux.front(), &receive.front(), n_elements, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    flux.swap(receive);
+  // find the time slices that have been counted into
+  int n_times = time_grid.size();
+  vector<int> used(n_times,0), used_any(n_times,0);
+  for (int t=0;t<n_times;t++)
+    for (int i=t*a1;i<(t+1)*a1;i++)
+      if (click[i] != 0) { used[t] = 1; break; }
+  MPI_Allreduce(&used.front(), &used_any.front(), n_times, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+  if (myID == receiving_ID)
+  {
+    flux_avg_.assign(n_elements,0.0);
+    click_avg_.assign(n_elements,0.0);
   }
 
-  // average clicks (receive goes out of scope after section)
+  // reduce each run of consecutive used time slices
+  int t = 0;
+  while (t < n_times)
   {
-    vector<double> receive;
-    receive.resize(n_elements);
-    for (int i=0;i<n_elements;++i) receive[i] = 0.0;
-    MPI_Allreduce(&click.front(), &receive.front(), n_elements, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    click.swap(receive);
+    if (!used_any[t]) { t++; continue; }
+    int t_start = t;
+    while ((t < n_times)&&(used_any[t])) t++;
+    int start = t_start*a1;
+    int size  = (t - t_start)*a1;
+
+    double *f_recv = (myID == receiving_ID) ? &flux_avg_[start]  : NULL;
+    double *c_recv = (myID == receiving_ID) ? &click_avg_[start] : NULL;
+    MPI_Reduce(&flux[start],  f_recv, size, MPI_DOUBLE, MPI_SUM, receiving_ID, MPI_COMM_WORLD);
+    MPI_Reduce(&click[start], c_recv, size, MPI_DOUBLE, MPI_SUM, receiving_ID, MPI_COMM_WORLD);
   }
 
   // only have the receiving ID do the division
-  MPI_Comm_size( MPI_COMM_WORLD, &mpi_procs );
-  MPI_Comm_rank( MPI_COMM_WORLD, &myID      );
-  //if(myID == receiving_ID){
-  //   #pragma omp parallel for
-  for (int i=0;i<n_elements;i++) {
-    flux[i]  /= mpi_procs;
-    click[i] /= mpi_procs;
+  if (myID == receiving_ID)
+  {
+    for (int i=0;i<n_elements;i++) {
+      flux_avg_[i]  /= mpi_procs;
+      click_avg_[i] /= mpi_procs;
+    }
   }
 
 #endif
 }
+
+//--------------------------------------------------------------
+// the spectrum to write out: the average over ranks if
+// MPI_average has made one, otherwise our own counts
+//--------------------------------------------------------------
+std::vector<double>& spectrum_array::output_flux()
+{
+  if (flux_avg_.empty()) return flux;
+  return flux_avg_;
+}
+
+std::vector<double>& spectrum_array::output_click()
+{
+  if (click_avg_.empty()) return click;
+  return click_avg_;
+}
+
+//--------------------------------------------------------------
+// release the memory of the averaged spectrum
+//--------------------------------------------------------------
+void spectrum_array::free_average()
+{
+  std::vector<double>().swap(flux_avg_);
+  std::vector<double>().swap(click_avg_);
+}
@@ -30,6 +30,25 @@ private:
   // the print method is the total number of clicks over all ranks.
   std::vector<double>    click;
 
+  // the average over all ranks, held only by rank 0 after
+  // MPI_average (empty otherwise, or on a single rank)
+  std::vector<double> flux_avg_, click_avg_;
+  std::vector<double>& output_flux();
+  std::vector<double>& output_click();
+  void free_average();
+
+  // copies of the counting arrays for the threads to count
+  // into, merged into flux/click before they are used. With
+  // one copy per thread no atomics are needed; if memory
+  // limits the number of copies, threads share them (striped
+  // by thread number) and count atomically, as they do if
+  // counting with more threads than when they were set up
+  int n_thread_copies_;
+  int thread_private_;
+  size_t copy_stride_;
+  std::vector<double> thread_flux_, thread_click_;
+  void merge_thread_copies();
+
   // Indexing
   int n_elements;
   int a1, a2, a3;
@@ -43,6 +62,15 @@ public:
   // Initialize
   void init(std::vector<double>,std::vector<double>,int,int);
   void set_name(std::string);
+  void setup_thread_copies(double max_mb);
+  int  n_thread_copies() const {return n_thread_copies_;}
+
+  // bytes held by the counting arrays and their copies
+  double memory_footprint() const
+  {
+    return sizeof(double)*(flux.size() + click.size() + flux_avg_.size() +
+      click_avg_.size() + thread_flux_.size() + thread_click_.size());
+  }
   
   // Count a packets
   void count(double t, double w, double E, double *D);
@@ -0,0 +1,101 @@
+#include <mpi.h>
+#include <math.h>
+#include <stdio.h>
+#include <vector>
+#include <omp.h>
+#include "spectrum_array.h"
+#include "test_utils.h"
+
+//---------------------------------------------------------
+// Timing of spectrum counting in an escape-heavy step, in
+// which all particles escape into the same few time bins,
+// with threads counting atomically into one spectrum and
+// into per-thread copies of it.  The two spectra must agree
+// exactly (the particle energies are small integers, so the
+// sums don't depend on the order of addition)
+//---------------------------------------------------------
+
+const int n_part = 4000000;
+
+struct escape
+{
+  double t, nu, E, D[3];
+};
+
+static double count_all(spectrum_array &s, const std::vector<escape> &esc)
+{
+  s.wipe();
+  double t0 = wall_time();
+  #pragma omp parallel for
+  for (int q=0;q<n_part;q++)
+  {
+    escape e = esc[q];
+    s.count(e.t,e.nu,e.E,e.D);
+  }
+  return wall_time() - t0;
+}
+
+int main(int argc, char **argv)
+{
+  MPI_Init(&argc,&argv);
+
+  // 100 time bins, 1000 log frequency bins, 4 mu bins
+  std::vector<double> t_grid = {0, 100, 1};
+  std::vector<double> nu_grid = {1e14, 1e16, 0.0046, 1};
+
+  // all particles escape in the last three time bins
+  std::vector<escape> esc(n_part);
+  for (int q=0;q<n_part;q++)
+  {
+    escape &e = esc[q];
+    e.t  = 97 + 3*lcg_uniform();
+    e.nu = 1e14*pow(100,lcg_uniform());
+    e.E  = 1 + (q % 3);
+    random_direction(e.D);
+  }
+
+  int n_fail = 0;
+  printf("# %8s %10s %10s %10s %8s\n","threads","copies","t_atom(s)","t_copy(s)","speedup");
+  for_thread_counts(64,[&](int nt) {
+    spectrum_array s_atom, s_copy;
+    s_atom.init(t_grid,nu_grid,4,1);
+    s_copy.init(t_grid,nu_grid,4,1);
+    s_atom.setup_thread_copies(0);
+    s_copy.setup_thread_copies(4096);
+
+    double t_atom = count_all(s_atom,esc);
+    double t_copy = count_all(s_copy,esc);
+
+    bool ok = s_atom.is_equal(s_copy,true);
+    printf("  %8d %10d %10.4f %10.4f %8.2f %s\n",nt,s_copy.n_thread_copies(),
+      t_atom,t_copy,t_atom/t_copy,check(ok,n_fail));
+  });
+
+  // striped: fewer copies than threads, shared atomically
+  omp_set_num_threads(8);
+  spectrum_array s_atom, s_stripe;
+  s_atom.init(t_grid,nu_grid,4,1);
+  s_stripe.init(t_grid,nu_grid,4,1);
+  s_atom.setup_thread_copies(0);
+  s_stripe.setup_thread_copies(13);
+  double t_atom   = count_all(s_atom,esc);
+  double t_stripe = count_all(s_stripe,esc);
+  bool ok = s_atom.is_equal(s_stripe,true);
+  printf("  %8d %10d %10.4f %10.4f %8.2f %s (striped)\n",8,s_stripe.n_thread_copies(),
+    t_atom,t_stripe,t_atom/t_stripe,check(ok,n_fail));
+
+  // copies set up for 4 threads, then counted into by 16
+  omp_set_num_threads(4);
+  spectrum_array s_grow;
+  s_grow.init(t_grid,nu_grid,4,1);
+  s_grow.setup_thread_copies(4096);
+  omp_set_num_threads(16);
+  t_atom = count_all(s_atom,esc);
+  double t_grow = count_all(s_grow,esc);
+  ok = s_atom.is_equal(s_grow,true);
+  printf("  %8d %10d %10.4f %10.4f %8.2f %s (more threads than copies)\n",16,
+    s_grow.n_thread_copies(),t_atom,t_grow,t_atom/t_grow,check(ok,n_fail));
+
+  MPI_Finalize();
+  return test_summary("spectrum counting",n_fail);
+}
@@ -0,0 +1,214 @@
+//------------------------------------------------------------
+// tally_statistics.cpp
+// This file contains functions that estimate the Monte Carlo
+// noise of the radiation tallies from batch statistics, and
+// that adapt the number of emitted particles to it
+//------------------------------------------------------------
+
+#include "hdf5.h"
+#include "hdf5_hl.h"
+
+#include <math.h>
+#include <iostream>
+#include <algorithm>
+#include "transport.h"
+#include "physical_constants.h"
+
+namespace pc = physical_constants;
+using std::cout;
+
+
+//------------------------------------------------------------
+// Clear the batch tallies at the start of a step.  During
+// propagation, e_abs and e_rad of each zone are added to the
+// tallies of the batch being propagated (tally_batch), and
+// the escaping luminosity in propagate_particle
+//------------------------------------------------------------
+void transport::wipe_batch_tallies()
+{
+  if (n_batches_ <= 0) return;
+  std::fill(batch_e_abs_.begin(),batch_e_abs_.end(),0.0);
+  std::fill(batch_e_rad_.begin(),batch_e_rad_.end(),0.0);
+  std::fill(batch_L_esc_.begin(),batch_L_esc_.end(),0.0);
+}
+
+
+//------------------------------------------------------------
+// relative error of the sum of B batch tallies x[0..B-1],
+// all separated by stride
+//------------------------------------------------------------
+static double batch_relerr(const double *x, int B, int stride, double &sum)
+{
+  sum = 0;
+  for (int k=0;k<B;k++) sum += x[k*stride];
+  if (sum <= 0) return 0;
+
+  double mean = sum/B;
+  double var  = 0;
+  for (int k=0;k<B;k++) var += (x[k*stride] - mean)*(x[k*stride] - mean);
+  var /= (B - 1.0);
+
+  // the total is a sum of B batches, so its variance is B*var
+  return sqrt(B*var)/sum;
+}
+
+
+//------------------------------------------------------------
+// Combine the batch tallies from all processors, compute
+// the relative errors of e_abs, e_rad and the escaping
+// spectrum, and (if wanted) set the emission scale factor
+// for the next step.  t_prop is the wall-clock time spent
+// propagating particles this step
+//------------------------------------------------------------
+void transport::reduce_batch_tallies(double t_prop)
+{
+  if (n_batches_ <= 0) return;
+
+  int nz  = grid->n_zones;
+  int nnu = nu_grid_.size();
+  int B   = n_batches_;
+
+#ifdef MPI_PARALLEL
+  if (MPI_nprocs > 1)
+  {
+    std::vector<double> dst(nz*B);
+    MPI_Allreduce(&batch_e_abs_[0],&dst[0],nz*B,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+    batch_e_abs_ = dst;
+    MPI_Allreduce(&batch_e_rad_[0],&dst[0],nz*B,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+    batch_e_rad_ = dst;
+    dst.resize(nnu*B);
+    MPI_Allreduce(&batch_L_esc_[0],&dst[0],nnu*B,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+    batch_L_esc_ = dst;
+
+    // the slowest rank sets the pace
+    double t_max;
+    MPI_Allreduce(&t_prop,&t_max,1,MPI_DOUBLE,MPI_MAX,MPI_COMM_WORLD);
+    t_prop = t_max;
+  }
+#endif
+
+  // relative errors in each zone, and their
+  // energy weighted averages over the grid
+  double sum;
+  double err_abs = 0, E_abs = 0;
+  double err_rad = 0, E_rad = 0;
+  for (int i=0;i<nz;i++)
+  {
+    e_abs_relerr_[i] = batch_relerr(&batch_e_abs_[i*B],B,1,sum);
+    err_abs += e_abs_relerr_[i]*sum;
+    E_abs   += sum;
+    e_rad_relerr_[i] = batch_relerr(&batch_e_rad_[i*B],B,1,sum);
+    err_rad += e_rad_relerr_[i]*sum;
+    E_rad   += sum;
+  }
+  if (E_abs > 0) err_abs /= E_abs;
+  if (E_rad > 0) err_rad /= E_rad;
+
+  // relative error of the escaping spectrum
+  double err_esc = 0, E_esc = 0;
+  for (int j=0;j<nnu;j++)
+  {
+    L_esc_relerr_[j] = batch_relerr(&batch_L_esc_[j],B,nnu,sum);
+    err_esc += L_esc_relerr_[j]*sum;
+    E_esc   += sum;
+  }
+  if (E_esc > 0) err_esc /= E_esc;
+
+  if (verbose)
+    cout << "# Tally relative errors: e_abs = " << err_abs << "; e_rad = " <<
+      err_rad << "; L_esc = " << err_esc << "\n";
+
+  if (particles_target_relerr_ <= 0) return;
+
+  // the error falls as 1/sqrt(N), so scale the emission by
+  // (err/target)^2, changing by at most a factor of 2 per step
+  double err = err_abs;
+  if (err_rad > err) err = err_rad;
+  if (err_esc > err) err = err_esc;
+  if (err <= 0) return;
+
+  double fac = pow(err/particles_target_relerr_,2);
+  if (fac > 2)   fac = 2;
+  if (fac < 0.5) fac = 0.5;
+
+  // don't let the next step run over the wall-clock budget
+  if ((particles_step_max_walltime_ > 0)&&(t_prop > 0))
+    if (fac*t_prop > particles_step_max_walltime_)
+      fac = particles_step_max_walltime_/t_prop;
+
+  emit_scale_ *= fac;
+  if (emit_scale_ > emit_scale_max_) emit_scale_ = emit_scale_max_;
+  if (emit_scale_ < emit_scale_min_) emit_scale_ = emit_scale_min_;
+
+  if (verbose)
+    cout << "# Scaling particle emission by " << emit_scale_ << "\n";
+}
+
+
+//------------------------------------------------------------
+// Add the relative errors of the tallies to a plotfile
+// assumes that the pltfile has already been created
+//------------------------------------------------------------
+void transport::write_tally_errors_to_plotfile(int iw)
+{
+  if (n_batches_ <= 0) return;
+
+  char zonefile[1000];
+  sprintf(zonefile,"plt_%05d.h5",iw);
+  hid_t file_id = H5Fopen( zonefile, H5F_ACC_RDWR, H5P_DEFAULT);
+  const int RANK = 1;
+
+  int nz = grid->n_zones;
+  float* tz_array = new float[nz];
+  hsize_t  dims_z[RANK]={(hsize_t)nz};
+
+  for (int i=0;i<nz;i++) tz_array[i] = e_abs_relerr_[i];
+  H5LTmake_dataset(file_id,"e_abs_relerr",RANK,dims_z,H5T_NATIVE_FLOAT,tz_array);
+  for (int i=0;i<nz;i++) tz_array[i] = e_rad_relerr_[i];
+  H5LTmake_dataset(file_id,"e_rad_relerr",RANK,dims_z,H5T_NATIVE_FLOAT,tz_array);
+  delete[] tz_array;
+
+  int n_nu = nu_grid_.size();
+  float* tmp_array = new float[n_nu];
+  hsize_t  dims[RANK]={(hsize_t)n_nu};
+  for (int j=0;j<n_nu;j++) tmp_array[j] = L_esc_relerr_[j];
+  H5LTmake_dataset(file_id,"Lnu_esc_relerr",RANK,dims,H5T_NATIVE_FLOAT,tmp_array);
+  delete[] tmp_array;
+
+  H5LTset_attribute_double(file_id,"/","emit_scale",&emit_scale_,1);
+
+  H5Fclose(file_id);
+}
+
+
+//------------------------------------------------------------
+// Checkpoint the emission scale factor, so that a restart
+// carries on with the adapted emission rather than from 1
+//------------------------------------------------------------
+void transport::writeCheckpointEmitScale(std::string fname)
+{
+  if (MPI_myID == 0)
+  {
+    hsize_t one[1] = {1};
+    createGroup(fname,"transport");
+    createDataset(fname,"transport","emit_scale",1,one,H5T_NATIVE_DOUBLE);
+    writeSimple(fname,"transport","emit_scale",&emit_scale_,H5T_NATIVE_DOUBLE);
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+}
+
+void transport::readCheckpointEmitScale(std::string fname)
+{
+  // (checkpoints from before it was saved start from 1)
+  if (MPI_myID == 0)
+  {
+    hid_t file_id = openH5File(fname);
+    if ((H5Lexists(file_id,"transport",H5P_DEFAULT) > 0)&&
+        (H5Lexists(file_id,"transport/emit_scale",H5P_DEFAULT) > 0))
+      readSimple(fname,"transport","emit_scale",&emit_scale_,H5T_NATIVE_DOUBLE);
+    closeH5File(file_id);
+  }
+  MPI_Bcast(&emit_scale_,1,MPI_DOUBLE,0,MPI_COMM_WORLD);
+  if (verbose)
+    cout << "# Restarting with particle emission scaled by " << emit_scale_ << "\n";
+}
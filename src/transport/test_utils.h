@@ -0,0 +1,96 @@
+#ifndef _TEST_UTILS_H
+#define _TEST_UTILS_H 1
+
+#include <math.h>
+#include <stdio.h>
+#include <chrono>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//**********************************************************
+// Helpers shared by the standalone tests and benchmarks
+// (the *_test.cpp programs and kernel_bench): reproducible
+// random numbers, a wall clock, running over thread counts
+// and reporting ok/FAIL results
+//**********************************************************
+
+//---------------------------------------------------------
+// simple, reproducible random numbers (a 64 bit LCG); the
+// test_RNG wraps them for code templated on an RNG
+//---------------------------------------------------------
+inline unsigned long long& lcg_state()
+{
+  static unsigned long long state = 12345;
+  return state;
+}
+
+inline double lcg_uniform()
+{
+  unsigned long long &s = lcg_state();
+  s = s*6364136223846793005ULL + 1442695040888963407ULL;
+  return (s >> 11)*(1.0/9007199254740992.0);
+}
+
+struct test_RNG
+{
+  double uniform() {return lcg_uniform();}
+};
+
+// an isotropic unit vector
+inline void random_direction(double D[3])
+{
+  double mu  = 1 - 2.0*lcg_uniform();
+  double phi = 2.0*M_PI*lcg_uniform();
+  double smu = sqrt(1 - mu*mu);
+  D[0] = smu*cos(phi);
+  D[1] = smu*sin(phi);
+  D[2] = mu;
+}
+
+
+//---------------------------------------------------------
+// wall clock time in seconds
+//---------------------------------------------------------
+inline double wall_time()
+{
+  std::chrono::duration<double> t = std::chrono::steady_clock::now().time_since_epoch();
+  return t.count();
+}
+
+
+//---------------------------------------------------------
+// call f(nt) with nt = 1,2,4... up to max_threads OpenMP
+// threads
+//---------------------------------------------------------
+template <class F>
+inline void for_thread_counts(int max_threads, F f)
+{
+  for (int nt=1;nt<=max_threads;nt*=2)
+  {
+#ifdef _OPENMP
+    omp_set_num_threads(nt);
+#endif
+    f(nt);
+  }
+}
+
+
+//---------------------------------------------------------
+// "ok" or "FAIL" for the end of a result line, counting the
+// failures; and the summary line and exit status of a test
+//---------------------------------------------------------
+inline const char* check(bool ok, int &n_fail)
+{
+  if (!ok) n_fail++;
+  return ok ? "ok" : "FAIL";
+}
+
+inline int test_summary(const char *what, int n_fail)
+{
+  if (n_fail) printf("# %d %s tests FAILED\n",n_fail,what);
+  else printf("# all %s tests passed\n",what);
+  return (n_fail > 0);
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include <cassert>
 #include <list>
 #include <algorithm>
+#include <chrono>
 #include <ctime>
 
 #include "transport.h"
@@ -25,6 +26,7 @@ namespace pc = physical_constants;
 //------------------------------------------------------------
 void transport::step(double dt)
 {
+  phase_timer timer("transport");
   // nominal time for iterative calc is 1
   if (this->steady_state) dt = 1;
 
@@ -34,61 +36,67 @@ void transport::step(double dt)
   // calculate the opacities
   set_opacity(dt); // need to pass dt for computing implicit monte carlo factors
 
-  // mpi combine the opacities calculated
+  // finish sharing the opacities calculated
   tstr = get_system_time();
   reduce_opacities();
-  reduce_Lthermal();
   tend = get_system_time();
   if (verbose) cout << "# Communicated opacities (" << (tend-tstr) << " secs) \n";
 
+  // even out the opacity work of the ranks for the next step
+  balance_zones();
+
   if (use_ddmc_) compute_diffusion_probabilities(dt);
 
   // clear the tallies of the radiation quantities in each zone
+  tstr = get_system_time();
   wipe_radiation();
+  wipe_batch_tallies();
+  tend = get_system_time();
+  if (verbose) cout << "# Cleared tallies        (" << (tend-tstr) << " secs) \n";
 
   // emit new particles
   tstr = get_system_time();
   emit_particles(dt);
 
+  // even out the estimated particle work of the ranks
+  balance_particles();
+
+  // put the gamma-rays first, so they are propagated together
+  std::partition(particles.begin(),particles.end(),
+    [](const particle &p) {return p.type == gammaray;});
+
   // Propagate the particles
   int n_active = particles.size();
   int n_particles = particles.size();
 
-  #pragma omp parallel for schedule(guided)
-  for(int i=0; i<n_particles; i++)
+  // particles are propagated in n_batches_ interleaved batches,
+  // so that the noise in the tallies can be estimated
+  phase_timer propagate_timer("propagate");
+  propagate_timer.count(n_particles);
+  int n_batch = (n_batches_ > 0) ? n_batches_ : 1;
+  for (int b=0; b<n_batch; b++)
   {
-    // propagate particles
-    particles[i].fate = propagate(particles[i],dt);
-
-    // Add escaped photons to output spectrum and escaped particle list
-    if (particles[i].fate == escaped)
+    batch_ = b;
+    // (time each thread's own share, without the wait at the end)
+    #pragma omp parallel
     {
-      // account for light crossing time, relative to grid center
-      double t_obs = particles[i].t - particles[i].x_dot_d()/pc::c;
-      if (particles[i].type == photon)
-        optical_spectrum.count(t_obs,particles[i].nu,particles[i].e,particles[i].D);
-      if (particles[i].type == gammaray)
-        gamma_spectrum.count(t_obs,particles[i].nu,particles[i].e,particles[i].D);
-      particles[i].t = t_obs;
-      if (save_escaped_particles_) {
-#pragma omp critical
-        {
-          if (maxn_escaped_particles_ >= particles_escaped.size()) {
-            particles_escaped.push_back(particles[i]);
-          }
-          else {
-            std::cerr << "# WARNING: Escaped particle list exceeds max size " 
-              << maxn_escaped_particles_ << std::endl;
-            std::cerr << "# Clearing escaped particle list on rank " << MPI_myID << std::endl;
-            clearEscapedParticles();
-          }
-        }
-      }
+      phase_timer thread_timer("particles");
+      #pragma omp for schedule(guided) nowait
+      for(int i=b; i<n_particles; i+=n_batch)
+        propagate_particle(particles[i],dt,b);
     }
   }
+  propagate_timer.stop();
+
+  // collect the gamma-ray energy deposited by each thread
+  reduce_gamma_deposition();
+  collect_escaped_particles();
+  reduce_zone_events();
 
   // Remove escaped and absorbed particles from the particle vector
+  double t_clean = get_system_time();
   int n_escaped = clean_up_particle_vector();
+  if (verbose) cout << "# Cleaned up particles   (" << (get_system_time()-t_clean) << " secs) \n";
 
   // calculate percent particles escaped, and rescale if wanted
   if (steady_state)
@@ -117,6 +125,9 @@ void transport::step(double dt)
   tend = get_system_time();
   if (verbose) cout << "# Propagated particles   (" << (tend-tstr) << " secs) \n";
 
+  // estimate the tally errors and adapt the emission
+  reduce_batch_tallies(tend-tstr);
+
   // normalize and MPI combine radiation tallies
   tstr = get_system_time();
   reduce_radiation(dt);
@@ -132,15 +143,67 @@ void transport::step(double dt)
   }
 
 
+  // resample the census particles to keep the population bounded
+  if (!steady_state) comb_particles();
+
   // advance time step
   if (!steady_state) t_now_ += dt;
 
   if (first_step_) first_step_ = 0.;
 
+  account_memory();
 }
 
 
 
+//--------------------------------------------------------
+// Propagate one particle through the time step, and add it
+// to the output spectrum and escaped particle list if it
+// escapes. b is the index of the batch it belongs to
+//--------------------------------------------------------
+void transport::propagate_particle(particle &p, double dt, int b)
+{
+  // note the events so far, to tally this particle's cost
+  // against the zone it started in
+  int i_start = p.ind;
+  long n_events_start = thread_events();
+
+  // propagate particles
+  p.fate = propagate(p,dt);
+
+  if ((particle_balance_)&&(i_start >= 0))
+    tally_particle_cost(i_start,thread_events() - n_events_start);
+
+  // Add escaped photons to output spectrum and escaped particle list
+  if (p.fate == escaped)
+  {
+    // account for light crossing time, relative to grid center
+    double t_obs = p.t - p.x_dot_d()/pc::c;
+    if (p.type == photon)
+      optical_spectrum.count(t_obs,p.nu,p.e,p.D);
+    if ((n_batches_ > 0)&&(p.type == photon))
+    {
+      int j = nu_grid_.locate_within_bounds(p.nu);
+      if (j >= (int)nu_grid_.size()) j = nu_grid_.size() - 1;
+      #pragma omp atomic
+      batch_L_esc_[b*nu_grid_.size() + j] += p.e;
+    }
+    if (p.type == gammaray)
+      gamma_spectrum.count(t_obs,p.nu,p.e,p.D);
+    p.t = t_obs;
+    if (save_escaped_particles_)
+    {
+#ifdef _OPENMP
+      int my_threadID = omp_get_thread_num();
+#else
+      int my_threadID = 0;
+#endif
+      escaped_thread_[my_threadID].push_back(p);
+    }
+  }
+}
+
+
 //--------------------------------------------------------
 // little local helper function to get the current
 // time for timing
@@ -150,7 +213,9 @@ double get_system_time()
 #ifdef MPI_PARALLEL
   return MPI_Wtime();
 #else
-  return  ((double)clock())  / (double)CLOCKS_PER_SEC;
+  // wall clock time (clock() would add up the time of all threads)
+  std::chrono::duration<double> t = std::chrono::steady_clock::now().time_since_epoch();
+  return t.count();
 #endif
 
 }
@@ -160,36 +225,55 @@ double get_system_time()
 // Loop over the vector of particles
 // and remove those that are either escaped or absorbed
 // Returns the number of particles that escaped
+//
+// Each thread compacts its own chunk of the vector, then
+// the chunks are moved together, keeping the particles
+// in their order
 //--------------------------------------------------------
 int transport::clean_up_particle_vector()
 {
+  phase_timer timer("clean_up");
+  int n = particles.size();
 
   // do nothing to an empty particle vector
-  if (particles.size() == 0) return 0;
+  if (n == 0) return 0;
+
+#ifdef _OPENMP
+  int n_chunks = omp_get_max_threads();
+#else
+  int n_chunks = 1;
+#endif
+  vector<int> n_kept(n_chunks);
 
   int n_escaped = 0;
-  int i=0;
-  while (true)
+  #pragma omp parallel for schedule(static) reduction(+:n_escaped)
+  for (int c=0;c<n_chunks;c++)
   {
-    // remove particles from back until we have one that is allive
-    while ((particles.back().fate == escaped)||(particles.back().fate == absorbed))
+    int start = (long)n*c/n_chunks;
+    int stop  = (long)n*(c+1)/n_chunks;
+    int k = start;
+    for (int q=start;q<stop;q++)
     {
-      if (particles.back().fate == escaped) n_escaped++;
-        particles.pop_back();
-        if (particles.size() == 0) break;
+      if (particles[q].fate == escaped) n_escaped++;
+      if ((particles[q].fate == escaped)||(particles[q].fate == absorbed)) continue;
+      if (k != q) particles[k] = particles[q];
+      k++;
     }
+    n_kept[c] = k - start;
+  }
 
-   // see if we've finished with all particles
-   if (i >= particles.size()) break;
+  // close the gaps between the chunks
+  int n_keep = n_kept[0];
+  for (int c=1;c<n_chunks;c++)
+  {
+    int start = (long)n*c/n_chunks;
+    if (start != n_keep)
+      std::copy(particles.begin() + start,particles.begin() + start + n_kept[c],
+        particles.begin() + n_keep);
+    n_keep += n_kept[c];
+  }
+  particles.resize(n_keep);
 
-   // check if we should remove this particle
-   if (particles[i].fate == escaped) n_escaped++;
-   if ((particles[i].fate == escaped)||(particles[i].fate == absorbed)){
-     particles[i] = particles.back();
-     particles.pop_back();
-   }
-   i = i+1;
- }
   return n_escaped;
 }
 
@@ -213,6 +297,13 @@ ParticleFate transport::propagate(particle &p, double dt)
   ParticleFate  fate = moving;
   while (fate == moving)
   {
+    // gamma-rays have their own transport kernel
+    if (p.type == gammaray)
+    {
+      fate = propagate_gamma(p, tstop);
+      continue;
+    }
+
     // check if we are in DDMC zone
     // Generalized to be particle- and frequency-dependent
     int in_ddmc_zone = 0;
@@ -265,6 +356,8 @@ ParticleFate transport::propagate_monte_carlo(particle &p, double tstop)
   ParticleFate  fate = moving;
   while (fate == moving)
   {
+    count_event();
+
     // set pointer to current zone
     assert(p.ind >= 0);
     zone *zone = &(grid->z[p.ind]);
@@ -367,8 +460,10 @@ ParticleFate transport::propagate_monte_carlo(particle &p, double tstop)
     // don't add gamma-rays here (they would be separate)
     if (p.type == photon)
     {
+      double this_E_abs = this_E*dshift*(continuum_opac_cmf)*eps_absorb_cmf*dshift * zone->eps_imc;
       #pragma omp atomic
-      zone->e_abs  += this_E*dshift*(continuum_opac_cmf)*eps_absorb_cmf*dshift * zone->eps_imc;
+      zone->e_abs  += this_E_abs;
+      tally_batch(p.ind,this_E_abs,this_E);
       if (store_Jnu_)
 	     #pragma omp atomic
 	      J_nu_[p.ind][i_nu] += this_E;
@@ -403,6 +498,9 @@ ParticleFate transport::propagate_monte_carlo(particle &p, double tstop)
     // ---------------------------------
     if (event == boundary)
     {
+      // (a frequency bin crossing keeps the zone index)
+      count_zone_event(p.ind,(new_ind == p.ind) ? zev_nu_cross : zev_zone_cross);
+
       // inner boundary hit
       if (new_ind == -1)
       {
@@ -484,6 +582,7 @@ ParticleFate transport::propagate_monte_carlo(particle &p, double tstop)
 }
 
 transport::~transport() {
+  free_node_shared_opacities();
   if (src_MPI_block)
     delete[] src_MPI_block;
   if (src_MPI_zones)
@@ -497,3 +596,36 @@ transport::~transport() {
 void transport::clearEscapedParticles() {
   particles_escaped.clear();
 }
+
+//------------------------------------------------------------
+// Append the particles that escaped on each thread to the
+// list of escaped particles, and clear the thread buffers.
+// If the list would exceed the maximum size, it is cleared
+//------------------------------------------------------------
+void transport::collect_escaped_particles()
+{
+  for (size_t t=0;t<escaped_thread_.size();t++)
+  {
+    vector<particle> &esc = escaped_thread_[t];
+    size_t q = 0;
+    while (q < esc.size())
+    {
+      size_t room = 0;
+      if (maxn_escaped_particles_ >= particles_escaped.size())
+        room = (size_t)(maxn_escaped_particles_ - particles_escaped.size()) + 1;
+      if (room == 0)
+      {
+        if (particles_escaped.empty()) break;
+        std::cerr << "# WARNING: Escaped particle list exceeds max size "
+          << maxn_escaped_particles_ << std::endl;
+        std::cerr << "# Clearing escaped particle list on rank " << MPI_myID << std::endl;
+        clearEscapedParticles();
+        continue;
+      }
+      size_t n = std::min(room,esc.size() - q);
+      particles_escaped.insert(particles_escaped.end(),esc.begin() + q,esc.begin() + q + n);
+      q += n;
+    }
+    esc.clear();
+  }
+}
@@ -9,6 +9,7 @@
 #include "particle.h"
 #include "grid_general.h"
 #include "cdf_array.h"
+#include "zone_array.h"
 #include "locate_array.h"
 #include "thread_RNG.h"
 #include "spectrum_array.h"
@@ -17,6 +18,7 @@
 #include "VoigtProfile.h"
 #include "sedona.h"
 #include "h5utils.h"
+#include "phase_timer.h"
 
 #ifdef MPI_PARALLEL
 #include <mpi.h>
@@ -44,6 +46,9 @@ using std::vector;
 
 class transport
 {
+  // the microbenchmarks (kernel_bench.cpp) time private kernels
+  friend class kernel_bench;
+  friend class transport_tester;
 
  private:
 
@@ -54,6 +59,21 @@ class transport
   std::vector<particle> particles_escaped_new;
   int max_total_particles;
 
+  // population control of census particles
+  int    comb_n_per_zone_;
+  int    comb_n_bands_;
+  double comb_tolerance_;
+
+  // batch statistics of the tallies and adaptive emission
+  int    n_batches_;
+  int    batch_;       // the batch being propagated
+  vector<double> batch_e_abs_, batch_e_rad_, batch_L_esc_;
+  vector<double> e_abs_relerr_, e_rad_relerr_, L_esc_relerr_;
+  double emit_scale_;
+  double particles_target_relerr_;
+  double particles_step_max_walltime_;
+  double emit_scale_min_, emit_scale_max_;
+
   // gas class for opacities
   vector<GasState> gas_state_vec_;
 
@@ -67,16 +87,57 @@ class transport
   int save_escaped_particles_;
   double maxn_escaped_particles_;
 
+  // escaped particles (if saved) and the zone level data (if
+  // written) are buffered per thread while propagating or
+  // calculating opacities, and collected once the threads are done
+  vector< vector<particle> > escaped_thread_;
+  vector< vector< std::pair<int, vector<double> > > > levels_thread_;
+
   // MPI stuff
   int MPI_nprocs;
   int MPI_myID;
   int my_zone_start_, my_zone_stop_;
+  vector<int> zone_block_start_;
   double *src_MPI_block, *dst_MPI_block;
   double *src_MPI_zones, *dst_MPI_zones;
 #ifdef MPI_PARALLEL
   MPI_Datatype MPI_real;
+  MPI_Datatype MPI_particle;   // one particle, so counts stay small
+#endif
+
+  // the opacities of my zones are calculated and sent to the
+  // other processors in rounds, so the two can overlap
+  int n_opacity_rounds_, nz_per_opacity_round_;
+#ifdef MPI_PARALLEL
+  struct opacity_round
+  {
+    int r;
+    vector<double> send, recv;
+    vector<int> counts, displs;
+    MPI_Request request;
+  };
+  std::list<opacity_round> opacity_rounds_in_flight_;
 #endif
 
+  // the opacity arrays can be kept in memory shared by all
+  // ranks on a node; rank_node_ holds the node of each rank
+  int node_shared_;
+  int node_rank_;
+  vector<int> rank_node_;
+#ifdef MPI_PARALLEL
+  MPI_Comm node_comm_;
+  vector<MPI_Win> node_windows_;
+#endif
+
+  // the zone blocks can be redrawn each step so that every
+  // rank has about the same opacity work, using the time
+  // each zone took to calculate (zone_cost_) last step
+  int zone_balance_;
+  double zone_balance_tolerance_;
+  int opacity_pipeline_blocks_;
+  int mpi_funneled_;   // MPI may be called from the OpenMP master thread
+  vector<double> zone_cost_;
+
   // simulation parameters
   double step_size_;
   int    steady_state;
@@ -90,10 +151,12 @@ class transport
   int    last_iteration_;
   int    omit_composition_decay_;
   int    compton_scatter_photons_;
+  int    compton_direct_sampling_;
   double fleck_alpha_;
   int    solve_Tgas_with_updated_opacities_;
   int    set_Tgas_to_Trad_;
   int    fix_Tgas_during_transport_;
+  int    emit_stratified_;
 
   int use_nlte_;
 
@@ -152,15 +215,42 @@ class transport
   vector<real>  emissivity_weight_;
 
   // the zone opacity/emissivity variables
-  vector< cdf_array<OpacityType> >    emissivity_;
-  vector< vector<OpacityType> >       abs_opacity_;
-  vector< vector<OpacityType> >       scat_opacity_;
+  cdf_zone_array<OpacityType>         emissivity_;
+  zone_array<OpacityType>             abs_opacity_;
+  zone_array<OpacityType>             scat_opacity_;
   vector<OpacityType> planck_mean_opacity_;
   vector<OpacityType> rosseland_mean_opacity_;
   vector< vector<real> > J_nu_;
   vector<real> compton_opac;
   vector<real> photoion_opac;
 
+  // gamma-ray opacity tables (uniform in log energy)
+  // and per-thread buffers of deposited gamma-ray energy
+  double gamma_logE_min_, gamma_dlogE_;
+  vector<double> gamma_kn_table_, gamma_pe_table_;
+  vector<double> L_radio_dep_thread_;
+
+  // particles can be moved among the ranks each step so that
+  // every rank has about the same work.  The work of a particle
+  // is estimated by the mean number of propagation events of
+  // particles that started in its zone last step (particle_cost_),
+  // tallied per thread.  n_events_thread_ counts the events on
+  // each thread (padded to one cache line per thread)
+  int particle_balance_;
+  double particle_balance_tolerance_;
+  vector<double> particle_cost_;
+  vector<double> cost_events_thread_, cost_count_thread_;
+  vector<long> n_events_thread_;
+
+  // (optional) counts of each kind of propagation event in each
+  // zone, tallied per thread, summed over ranks each step and
+  // written to the plotfiles, to show where the work goes
+  enum ZoneEvent {zev_scatter, zev_zone_cross, zev_nu_cross, zev_ddmc, zev_walk,
+    n_zone_event_types};
+  int count_zone_events_;
+  vector<double> zone_events_thread_;
+  vector<double> zone_events_;
+
   // the following are only resized and used if gas_state_.use_nlte_ is set to 1
   vector<real> bf_heating;
   vector<real> bf_cooling;
@@ -196,6 +286,21 @@ class transport
   double klein_nishina(double);
   double blackbody_nu(double T, double nu);
   void   reduce_opacities();
+  int    opacity_row_size() const;
+  void   setup_opacity_rounds(int);
+  void   opacity_round_zones(int, int, int&, int&) const;
+  void   send_opacity_round(int);
+#ifdef MPI_PARALLEL
+  void   finish_opacity_round(opacity_round&);
+#endif
+  void   setup_node_comm();
+  void   setup_node_shared_opacities();
+  void   free_node_shared_opacities();
+  void   node_barrier();
+  void   balance_zones();
+
+  // set the memory accounts of the transport arrays
+  void   account_memory();
 
   // creation of particles functions
   void   emit_particles(double dt);
@@ -205,9 +310,31 @@ class transport
   void   emit_heating_source(double dt);
   void   emit_from_pointsoures(double dt);
   void   create_isotropic_particle(int,PType,double,double);
+  void   setup_isotropic_particle(particle&,int,PType,double,double);
+  void   allocate_zone_emission(int,vector<int>&);
   void   initialize_particles(int);
   void sample_photon_frequency(particle*);
 
+  // population control of census particles
+  void   comb_particles();
+  int    comb_group(const particle&) const;
+  int    comb_n_groups() const;
+
+  // batch statistics of the tallies
+  void   wipe_batch_tallies();
+  void   reduce_batch_tallies(double);
+
+  // add to the tallies of zone i in the batch being propagated
+  void tally_batch(int i, double e_abs, double e_rad)
+  {
+    if (n_batches_ <= 0) return;
+    size_t k = (size_t)i*n_batches_ + batch_;
+    #pragma omp atomic
+    batch_e_abs_[k] += e_abs;
+    #pragma omp atomic
+    batch_e_rad_[k] += e_rad;
+  }
+
   // special relativistic functions
   void   transform_comoving_to_lab(particle*);
   void   transform_lab_to_comoving(particle*);
@@ -231,6 +358,58 @@ class transport
   void compute_diffusion_probabilities(double dt);
   void sample_dir_from_blackbody_surface(particle*);
   int clean_up_particle_vector();
+  void propagate_particle(particle &p, double dt, int batch);
+
+  // balancing of the particle work among ranks
+  void setup_particle_balance();
+  void balance_particles();
+  void tally_particle_cost(int, long);
+  void reduce_particle_costs();
+  double particle_cost(const particle&) const;
+
+  // count one propagation event on this thread
+  void count_event()
+  {
+#ifdef _OPENMP
+    n_events_thread_[8*omp_get_thread_num()]++;
+#else
+    n_events_thread_[0]++;
+#endif
+  }
+
+  // count one event of type e in zone i on this thread
+  void count_zone_event(int i, int e)
+  {
+    if ((!count_zone_events_)||(i < 0)) return;
+#ifdef _OPENMP
+    int my_threadID = omp_get_thread_num();
+#else
+    int my_threadID = 0;
+#endif
+    int nz = grid->n_zones;
+    zone_events_thread_[(my_threadID*n_zone_event_types + e)*nz + i] += 1;
+  }
+
+  // per-zone event counts
+  void setup_zone_events();
+  void reduce_zone_events();
+
+  // the number of events counted so far on this thread
+  long thread_events() const
+  {
+#ifdef _OPENMP
+    return n_events_thread_[8*omp_get_thread_num()];
+#else
+    return n_events_thread_[0];
+#endif
+  }
+
+  // gamma-ray transport
+  ParticleFate propagate_gamma(particle &p, double tstop);
+  void setup_gamma_opacity_table();
+  void get_gamma_opacity(int, double, double&, double&);
+  void deposit_gamma(int, double);
+  void reduce_gamma_deposition();
 
   // scattering functions
   ParticleFate do_scatter(particle*, double);
@@ -241,9 +420,8 @@ class transport
   // radiation quantities functions
   void wipe_radiation();
   void reduce_radiation(double);
+  void radiation_rounds(int, int&, int&) const;
   void reduce_Tgas();
-  void reduce_n_elec();
-  void reduce_Lthermal();
 
   // solve equilibrium temperature
   int solve_state_and_temperature(GasState*, int); // calls gas state solve from within interative solution for tempreature. For now, temperature solve is always based on radiative equilibrium
@@ -267,6 +445,11 @@ class transport
   transport()
   {
     time_core_ = 0;
+    node_shared_ = 0;
+    node_rank_ = 0;
+    use_ddmc_ = 0;
+    src_MPI_block = dst_MPI_block = NULL;
+    src_MPI_zones = dst_MPI_zones = NULL;
   }
 
   // destructor
@@ -294,8 +477,12 @@ class transport
   // print out functions
   void write_levels_to_plotfile(int);
   void write_radiation_file(int);
+  void write_tally_errors_to_plotfile(int);
+  void write_zone_events_to_plotfile(int);
   void wipe_spectra();
   void clearEscapedParticles();
+  void collect_escaped_particles();
+  void flush_levels();
 
   void writeCheckpointParticlesAll(std::string fname);
   void writeCheckpointParticles(std::vector<particle>& particle_list,
@@ -305,6 +492,7 @@ class transport
       int total_particles, int offset);
   void writeCheckpointSpectra(std::string fname);
   void writeCheckpointRNG(std::string fname);
+  void writeCheckpointEmitScale(std::string fname);
 
   void readCheckpointParticles(std::vector<particle>& particle_list, 
       std::string fname, std::string groupname, bool test=false,
@@ -314,6 +502,7 @@ class transport
       int total_particles, int offset);
   void readCheckpointSpectra(std::string fname, bool test=false);
   void readCheckpointRNG(std::string fname, bool test=false);
+  void readCheckpointEmitScale(std::string fname);
 
   void testCheckpointParticles(std::string fname);
   void testCheckpointSpectrum(std::string fname);
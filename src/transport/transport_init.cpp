@@ -13,6 +13,7 @@
 #include "transport.h"
 #include "ParameterReader.h"
 #include "physical_constants.h"
+#include "memory_accounts.h"
 
 
 using std::cout;
@@ -58,11 +59,14 @@ void transport::init(ParameterReader* par, grid_general *g)
   int remainder = nz - blocks*MPI_nprocs;
 
   int rcount = 0;
+  zone_block_start_.resize(MPI_nprocs+1);
+  zone_block_start_[MPI_nprocs] = nz;
   for (int i=0;i<MPI_nprocs;i++)
   {
     int start = i*blocks + rcount;
     int stop  = start + blocks;
     if (rcount < remainder) { stop += 1; rcount += 1;}
+    zone_block_start_[i] = start;
     if (i == MPI_myID)
     {
       my_zone_start_ = start;
@@ -96,6 +100,22 @@ void transport::init(ParameterReader* par, grid_general *g)
 
   // read relevant parameters
   max_total_particles = params_->getScalar<int>("particles_max_total");
+  comb_n_per_zone_ = params_->getScalar<int>("particles_comb_n_per_zone");
+  comb_n_bands_    = params_->getScalar<int>("particles_comb_n_bands");
+  comb_tolerance_  = params_->getScalar<double>("particles_comb_tolerance");
+  if (comb_n_bands_ < 1) comb_n_bands_ = 1;
+  if (comb_tolerance_ < 1) comb_tolerance_ = 1;
+  emit_stratified_ = params_->getScalar<int>("particles_emit_stratified");
+  n_batches_ = params_->getScalar<int>("transport_n_batches");
+  particles_target_relerr_ = params_->getScalar<double>("particles_target_relerr");
+  particles_step_max_walltime_ = params_->getScalar<double>("particles_step_max_walltime");
+  emit_scale_min_ = params_->getScalar<double>("particles_emit_scale_min");
+  emit_scale_max_ = params_->getScalar<double>("particles_emit_scale_max");
+  emit_scale_ = 1;
+  batch_ = 0;
+  if ((particles_target_relerr_ > 0)&&(n_batches_ < 2)) n_batches_ = 10;
+  if (n_batches_ == 1) n_batches_ = 0;
+  if (do_restart) readCheckpointEmitScale(restart_file);
   radiative_eq    = params_->getScalar<int>("transport_radiative_equilibrium");
   steady_state    = (params_->getScalar<int>("transport_steady_iterate") > 0);
   temp_max_value_ = params_->getScalar<double>("limits_temp_max");
@@ -172,6 +192,13 @@ void transport::init(ParameterReader* par, grid_general *g)
     std::vector<double>gng = params_->getVector<double>("gamma_nu_grid");
     gamma_spectrum.init(stg,sng,nmu,nphi);
   }
+  // per-thread copies of the spectra to count escapes into
+  double spec_max_mb = params_->getScalar<double>("spectrum_thread_copies_max_mb");
+  optical_spectrum.setup_thread_copies(spec_max_mb);
+  gamma_spectrum.setup_thread_copies(spec_max_mb);
+  if (verbose)
+    std::cout << "# spectra counted into " << optical_spectrum.n_thread_copies()
+      << " thread copies\n";
   escaped_particle_filename_ = params_->getScalar<string>("spectrum_particle_list_name");
   if (escaped_particle_filename_ == "")
     save_escaped_particles_ = 0;
@@ -199,6 +226,8 @@ void transport::init(ParameterReader* par, grid_general *g)
   int max_nthreads = 1;
 #endif
   gas_state_vec_.resize(max_nthreads);
+  escaped_thread_.resize(max_nthreads);
+  levels_thread_.resize(max_nthreads);
 
   int n_fuzzlines = 0;
   std::string fuzzfile = "";
@@ -278,35 +307,34 @@ void transport::init(ParameterReader* par, grid_general *g)
   rosseland_mean_opacity_.resize(grid->n_zones);
   n_grid_variables += 2;
 
-  abs_opacity_.resize(grid->n_zones);
-  if (!omit_scattering_) scat_opacity_.resize(grid->n_zones);
-  emissivity_.resize(grid->n_zones);
   J_nu_.resize(grid->n_zones);
   n_freq_variables += 2;
   if (!omit_scattering_) n_freq_variables +=1;
   if (store_Jnu_) n_freq_variables += 1;
 
-  for (int i=0; i<grid->n_zones;  i++)
+  // allocate absorptive and scattering opacity, and emissivity
+  // (either per rank or shared by the ranks on a node)
+  node_shared_ = params_->getScalar<int>("transport_node_shared_opacities");
+  if (MPI_nprocs == 1) node_shared_ = 0;
+  // (check they fit before allocating them)
+  if (node_shared_) setup_node_comm();
+  account_memory();
+  if (node_shared_) setup_node_shared_opacities();
+  else
   {
-    // allocate absorptive opacity
     try {
-      abs_opacity_[i].resize(nu_grid_.size()); }
+      abs_opacity_.resize(grid->n_zones,nu_grid_.size());
+      if (!omit_scattering_) scat_opacity_.resize(grid->n_zones,nu_grid_.size());
+      emissivity_.resize(grid->n_zones,nu_grid_.size()); }
     catch (std::bad_alloc const&) {
       cerr << "Memory allocation fail!" << std::endl; }
+  }
 
-    // allocate scattering opacity
-    if (!omit_scattering_)
-    {
-        try {
-            scat_opacity_[i].resize(nu_grid_.size()); }
-        catch (std::bad_alloc const&) {
-            cerr << "Memory allocation fail!" << std::endl; }
-    }
-
-    // allocate emissivity
-    emissivity_[i].resize(nu_grid_.size());
-
-    // allocate Jnu (radiation field)
+  // allocate Jnu (radiation field), each zone on the thread
+  // that will first touch it
+  #pragma omp parallel for schedule(static)
+  for (int i=0; i<grid->n_zones;  i++)
+  {
     if (store_Jnu_)
     {
       J_nu_[i].resize(nu_grid_.size());
@@ -317,6 +345,28 @@ void transport::init(ParameterReader* par, grid_general *g)
   compton_opac.resize(grid->n_zones);
   photoion_opac.resize(grid->n_zones);
   n_grid_variables += 2;
+  setup_gamma_opacity_table();
+  opacity_pipeline_blocks_ = params_->getScalar<int>("transport_opacity_pipeline_blocks");
+  setup_opacity_rounds(opacity_pipeline_blocks_);
+  zone_cost_.assign(grid->n_zones,0);
+  zone_balance_ = params_->getScalar<int>("transport_zone_balance");
+  zone_balance_tolerance_ = params_->getScalar<double>("transport_zone_balance_tolerance");
+  particle_balance_ = params_->getScalar<int>("transport_particle_balance");
+  particle_balance_tolerance_ = params_->getScalar<double>("transport_particle_balance_tolerance");
+  if (MPI_nprocs == 1) particle_balance_ = 0;
+  setup_particle_balance();
+  setup_zone_events();
+
+  // batch tallies for error estimates
+  if (n_batches_ > 0)
+  {
+    batch_e_abs_.resize(grid->n_zones*n_batches_);
+    batch_e_rad_.resize(grid->n_zones*n_batches_);
+    batch_L_esc_.resize(nu_grid_.size()*n_batches_);
+    e_abs_relerr_.assign(grid->n_zones,0);
+    e_rad_relerr_.assign(grid->n_zones,0);
+    L_esc_relerr_.assign(nu_grid_.size(),0);
+  }
 
   // setup emissivity weight  -- debug
   emissivity_weight_.resize(nu_grid_.size());
@@ -382,6 +432,15 @@ void transport::init(ParameterReader* par, grid_general *g)
   if (compton_scatter_photons_)
     setup_MB_cdf(0.,5.,512); // in non-dimensional velocity units
 
+  std::string compton_sampler = params_->getScalar<string>("opacity_compton_sampler");
+  if (compton_sampler == "direct") compton_direct_sampling_ = 1;
+  else if (compton_sampler == "rejection") compton_direct_sampling_ = 0;
+  else
+  {
+    if (verbose) cerr << "# ERROR: opacity_compton_sampler must be direct or rejection" << endl;
+    exit(1);
+  }
+
   // print out memory footprint
   if (verbose)
   {
@@ -423,7 +482,54 @@ void transport::init(ParameterReader* par, grid_general *g)
     std::cout << std::endl;
     }
 
+  account_memory();
+}
+
 
+//----------------------------------------------------------------------------
+// Set the memory accounts of the arrays of transport: the
+// zone opacities and radiation field (from their sizes, so
+// this can be called before they are allocated), the other
+// per zone variables, the particles (which may grow to
+// particles_max_total), spectra, atomic data and gas states.
+// Node-shared opacities are charged to the first rank of
+// each node (found by setup_node_comm before this is first
+// called)
+//----------------------------------------------------------------------------
+void transport::account_memory()
+{
+  memory_account_set &mem = memory_accounts();
+  double nz = grid->n_zones;
+  double nw = nu_grid_.size();
+
+  mem.set("grid zones",sizeof(zone)*(double)(grid->z.capacity() + grid->z_new.capacity()));
+
+  double n_opac = omit_scattering_ ? 2 : 3;
+  if ((node_shared_)&&(node_rank_ != 0)) n_opac = 0;
+  mem.set("opacities, emissivity",n_opac*nz*nw*sizeof(OpacityType));
+  mem.set("radiation field (J_nu)",nz*(store_Jnu_ ? nw : 1)*sizeof(real));
+
+  // opacity means, compton and photoion opacities, emission
+  // cdf, NLTE heating/cooling and DDMC probabilities, and
+  // the costs and event counts of the zones
+  double n_zone_vars = 5 + (use_nlte_ ? 5 : 0) + (use_ddmc_ ? 6 : 0);
+  mem.set("zone variables",sizeof(double)*(n_zone_vars*nz + zone_cost_.size() +
+    zone_events_thread_.size() + zone_events_.size()));
+  if (n_batches_ > 0)
+    mem.set("batch tallies",sizeof(double)*(n_batches_ + 1)*(2*nz + nw));
+
+  double n_escaped = particles_escaped.capacity();
+  for (size_t t=0;t<escaped_thread_.size();t++) n_escaped += escaped_thread_[t].capacity();
+  mem.set("particles",sizeof(particle)*(double)particles.capacity(),
+    sizeof(particle)*(double)max_total_particles);
+  mem.set("escaped particles",sizeof(particle)*n_escaped);
+  mem.set("spectra",optical_spectrum.memory_footprint() + gamma_spectrum.memory_footprint());
+
+  double n_gas = 0;
+  for (size_t i=0;i<gas_state_vec_.size();i++) n_gas += gas_state_vec_[i].state_footprint();
+  if (gas_state_vec_.size() > 0)
+    mem.set("atomic data",gas_state_vec_[0].atomic_data_footprint());
+  mem.set("gas states",n_gas);
 }
 
 void transport::setup_MPI()
@@ -433,9 +539,18 @@ void transport::setup_MPI()
   MPI_Comm_size( MPI_COMM_WORLD, &MPI_nprocs );
   MPI_Comm_rank( MPI_COMM_WORLD, &MPI_myID  );
   MPI_real = ( sizeof(real)==4 ? MPI_FLOAT : MPI_DOUBLE );
+  MPI_Type_contiguous(sizeof(particle),MPI_BYTE,&MPI_particle);
+  MPI_Type_commit(&MPI_particle);
+
+  // the opacity rounds are sent from within the OpenMP
+  // region only if MPI supports it (see main)
+  int thread_level;
+  MPI_Query_thread(&thread_level);
+  mpi_funneled_ = (thread_level >= MPI_THREAD_FUNNELED);
 #else
   MPI_nprocs = 1;
   MPI_myID= 0;
+  mpi_funneled_ = 1;
 #endif
   verbose = (MPI_myID==0);
 }
@@ -6,6 +6,7 @@
 
 #include <math.h>
 #include <cassert>
+#include <algorithm>
 #include "transport.h"
 #include "physical_constants.h"
 
@@ -17,6 +18,8 @@ namespace pc = physical_constants;
 //------------------------------------------------------------
 void transport::wipe_radiation()
 {
+  phase_timer timer("wipe");
+  #pragma omp parallel for schedule(static)
   for (int i=0;i<grid->n_zones;i++)
   {
     grid->z[i].e_rad  = 0;
@@ -33,180 +36,208 @@ void transport::wipe_radiation()
   }
 }
 
+// number of zone scalars sent ahead of the frequency dependent
+// opacities, and the most rounds that may be in flight at once
+static const int n_opacity_scalars = 8;
+static const int max_opacity_rounds_in_flight = 4;
+
 //------------------------------------------------------------
-// Combine the opacity calculations in all zones
-// from all processors using MPI
+// number of values sent per zone in the opacity gather
 //------------------------------------------------------------
-void transport::reduce_opacities()
+int transport::opacity_row_size() const
 {
+  int n_rows = 2;
+  if (!omit_scattering_) n_rows = 3;
+  return n_opacity_scalars + n_rows*nu_grid_.size();
+}
 
-#ifndef MPI_PARALLEL
-  return;
-#else
-  if (MPI_nprocs == 1) return;
-
-
-   //=************************************************
-  // do zone vectors
-  //=************************************************
-
-  // dimensions
-  int nw = nu_grid_.size();
-  int nz = grid->n_zones;
-
-  // maximum size of transfer blocks
-  int max_blocksize = Max_MPI_Blocksize;
-  if (nw > Max_MPI_Blocksize) {
+//------------------------------------------------------------
+// Split each processor's block of zones into the rounds in
+// which their opacities are calculated and shared. There are
+// at least n_blocks rounds, and enough that the messages of a
+// round stay below Max_MPI_Blocksize
+//------------------------------------------------------------
+void transport::setup_opacity_rounds(int n_blocks)
+{
+  int row = opacity_row_size();
+  if (row > Max_MPI_Blocksize) {
     std::cerr << "Error, frequency grid is bigger than MPI_Max_Blocksize" << std::endl;
     exit(1);
   }
 
-  // number of zones that fit into a transfer block
-  int nz_per_block      = floor(1.0*max_blocksize/nw);
-  // actual blocksize and # of blocks
-  int blocksize         = nz_per_block*nw;
-  int n_blocks          = floor(1.0*nw*nz/blocksize);
-  // size of last block to pick up remainder
-  int last_blocksize    = nw*nz - n_blocks*blocksize;
-  int last_nz_per_block = nz - nz_per_block*n_blocks;
-
-  // sanity check
-  if (blocksize > Max_MPI_Blocksize)
+  int max_block = 0;
+  for (int p=0;p<MPI_nprocs;p++)
   {
-    std::cerr << "Error, Blocksize greater than MPI_Max_Blocksize" << std::endl;
-    exit(1);
+    int nb = zone_block_start_[p+1] - zone_block_start_[p];
+    if (nb > max_block) max_block = nb;
   }
+  if (n_blocks < 1) n_blocks = 1;
+
+  nz_per_opacity_round_ = (max_block + n_blocks - 1)/n_blocks;
+  int nz_max = floor(1.0*Max_MPI_Blocksize/(1.0*row*MPI_nprocs));
+  if (nz_per_opacity_round_ > nz_max) nz_per_opacity_round_ = nz_max;
+  if (nz_per_opacity_round_ < 1) nz_per_opacity_round_ = 1;
+  n_opacity_rounds_ = (max_block + nz_per_opacity_round_ - 1)/nz_per_opacity_round_;
+  if (n_opacity_rounds_ < 1) n_opacity_rounds_ = 1;
+}
 
-  int cnt;
-  //-----------------------------
-  // loop over blocks
-  //-----------------------------
-  for (int i=0;i<n_blocks+1;i++)
-  {
-    int this_nz        = nz_per_block;
-    int this_blocksize = blocksize;
-    if (i == n_blocks) {
-      this_nz = last_nz_per_block;
-      this_blocksize = last_blocksize; }
-
-    //-----------------------------
-    // absorptive opacity
-    //-----------------------------
-    cnt = 0;
-    for (int j=0;j<this_nz;j++)
-    {
-      int iz = i*nz_per_block + j;
-      for (int k=0;k<nw;k++)
-      {
-        src_MPI_block[cnt] = abs_opacity_[iz][k];
-        dst_MPI_block[cnt] = 0.0;
-        cnt++;
-      }
-    }
-    MPI_Allreduce(src_MPI_block,dst_MPI_block,this_blocksize,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    cnt = 0;
-    for (int j=0;j<this_nz;j++)
-    {
-      int iz = i*nz_per_block + j;
-      for (int k=0;k<nw;k++)
-      {
-        abs_opacity_[iz][k] = (OpacityType)dst_MPI_block[cnt];
-        cnt++;
-      }
-    }
+//------------------------------------------------------------
+// the zones [start,stop) of processor p done in round r
+//------------------------------------------------------------
+void transport::opacity_round_zones(int r, int p, int &start, int &stop) const
+{
+  start = zone_block_start_[p] + r*nz_per_opacity_round_;
+  stop  = start + nz_per_opacity_round_;
+  if (stop  > zone_block_start_[p+1]) stop  = zone_block_start_[p+1];
+  if (start > stop) start = stop;
+}
+
+//------------------------------------------------------------
+// Start sharing the opacities of my zones in round r with
+// all processors (non-blocking). Any earlier rounds that
+// have arrived are unpacked, and if too many are in flight
+// we wait for the oldest
+//------------------------------------------------------------
+void transport::send_opacity_round(int r)
+{
+#ifdef MPI_PARALLEL
+  if (MPI_nprocs == 1) return;
 
-    //-----------------------------
-    // scattering opacity
-    //-----------------------------
+  int nw  = nu_grid_.size();
+  int row = opacity_row_size();
+
+  opacity_rounds_in_flight_.push_back(opacity_round());
+  opacity_round &o = opacity_rounds_in_flight_.back();
+  o.r = r;
+  o.counts.resize(MPI_nprocs);
+  o.displs.resize(MPI_nprocs);
+
+  // number of values from each processor this round
+  int n_tot = 0;
+  for (int p=0;p<MPI_nprocs;p++)
+  {
+    int start, stop;
+    opacity_round_zones(r,p,start,stop);
+    o.counts[p] = (stop - start)*row;
+    o.displs[p] = n_tot;
+    n_tot      += o.counts[p];
+  }
+  o.recv.resize(n_tot);
+
+  // pack my zones
+  int start, stop;
+  opacity_round_zones(r,MPI_myID,start,stop);
+  o.send.resize(o.counts[MPI_myID]);
+  int cnt = 0;
+  for (int i=start;i<stop;i++)
+  {
+    o.send[cnt++] = compton_opac[i];
+    o.send[cnt++] = photoion_opac[i];
+    o.send[cnt++] = rosseland_mean_opacity_[i];
+    o.send[cnt++] = planck_mean_opacity_[i];
+    o.send[cnt++] = grid->z[i].n_elec;
+    o.send[cnt++] = grid->z[i].L_thermal;
+    o.send[cnt++] = grid->z[i].eps_imc;
+    o.send[cnt++] = zone_cost_[i];
+    for (int k=0;k<nw;k++) o.send[cnt++] = abs_opacity_[i][k];
+    for (int k=0;k<nw;k++) o.send[cnt++] = emissivity_[i].get(k);
     if (!omit_scattering_)
-    {
-      cnt = 0;
-      for (int j=0;j<this_nz;j++)
-      {
-        int iz = i*nz_per_block + j;
-        for (int k=0;k<nw;k++)
-        {
-          src_MPI_block[cnt] = scat_opacity_[iz][k];
-          dst_MPI_block[cnt] = 0.0;
-          cnt++;
-        }
-      }
-      MPI_Allreduce(src_MPI_block,dst_MPI_block,this_blocksize,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-      cnt = 0;
-      for (int j=0;j<this_nz;j++)
-      {
-        int iz = i*nz_per_block + j;
-        for (int k=0;k<nw;k++)
-        {
-          scat_opacity_[iz][k] = (OpacityType)dst_MPI_block[cnt];
-          cnt++;
-        }
-      }
-    }
-    //-----------------------------
-    // emissivity
-    //-----------------------------
-    cnt = 0;
-    for (int j=0;j<this_nz;j++)
-    {
-      int iz = i*nz_per_block + j;
-      for (int k=0;k<nw;k++)
-      {
-        src_MPI_block[cnt] = emissivity_[iz].get(k);
-        dst_MPI_block[cnt] = 0.0;
-        cnt++;
-      }
-    }
-    MPI_Allreduce(src_MPI_block,dst_MPI_block,this_blocksize,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    cnt = 0;
-    for (int j=0;j<this_nz;j++)
-    {
-      int iz = i*nz_per_block + j;
-      for (int k=0;k<nw;k++)
-      {
-        emissivity_[iz].set(k,(OpacityType)dst_MPI_block[cnt]);
-        cnt++;
-      }
-    }
+      for (int k=0;k<nw;k++) o.send[cnt++] = scat_opacity_[i][k];
   }
 
-  //=************************************************
-  // do zone scalars
-  //=************************************************
-  for (int i=0;i<nz;i++)
+  double *sendbuf = o.send.empty() ? NULL : &o.send[0];
+  double *recvbuf = o.recv.empty() ? NULL : &o.recv[0];
+  MPI_Iallgatherv(sendbuf,o.counts[MPI_myID],MPI_DOUBLE,recvbuf,
+    &o.counts[0],&o.displs[0],MPI_DOUBLE,MPI_COMM_WORLD,&o.request);
+
+  // unpack whatever has arrived (this also drives progress)
+  std::list<opacity_round>::iterator it = opacity_rounds_in_flight_.begin();
+  while (it != opacity_rounds_in_flight_.end())
   {
-    src_MPI_zones[i] = compton_opac[i];
-    dst_MPI_zones[i] = 0.0;
+    int done;
+    MPI_Test(&(it->request),&done,MPI_STATUS_IGNORE);
+    if (done)
+    {
+      finish_opacity_round(*it);
+      it = opacity_rounds_in_flight_.erase(it);
+    }
+    else ++it;
   }
-  MPI_Allreduce(src_MPI_zones,dst_MPI_zones,nz,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-  for (int i=0;i<nz;i++) compton_opac[i] = dst_MPI_zones[i];
-
-  for (int i=0;i<nz;i++)
+  while ((int)opacity_rounds_in_flight_.size() > max_opacity_rounds_in_flight)
   {
-    src_MPI_zones[i] = photoion_opac[i];
-    dst_MPI_zones[i] = 0.0;
+    finish_opacity_round(opacity_rounds_in_flight_.front());
+    opacity_rounds_in_flight_.pop_front();
   }
-  MPI_Allreduce(src_MPI_zones,dst_MPI_zones,nz,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-  for (int i=0;i<nz;i++) photoion_opac[i] = dst_MPI_zones[i];
+#endif
+}
 
-  for (int i=0;i<nz;i++)
+#ifdef MPI_PARALLEL
+//------------------------------------------------------------
+// wait for a round of the opacity gather to complete, and
+// unpack the zones of the other processors
+//------------------------------------------------------------
+void transport::finish_opacity_round(opacity_round &o)
+{
+  MPI_Wait(&o.request,MPI_STATUS_IGNORE);
+
+  int nw  = nu_grid_.size();
+  int row = opacity_row_size();
+  for (int p=0;p<MPI_nprocs;p++)
   {
-    src_MPI_zones[i] = rosseland_mean_opacity_[i];
-    dst_MPI_zones[i] = 0.0;
+    if (p == MPI_myID) continue;
+    int start, stop;
+    opacity_round_zones(o.r,p,start,stop);
+    int cnt = o.displs[p];
+
+    // node-shared rows are written once per node, and not at
+    // all if they were calculated on this node
+    bool write_rows = true;
+    if (node_shared_)
+      write_rows = (node_rank_ == 0)&&(rank_node_[p] != rank_node_[MPI_myID]);
+
+    for (int i=start;i<stop;i++)
+    {
+      compton_opac[i]            = o.recv[cnt++];
+      photoion_opac[i]           = o.recv[cnt++];
+      rosseland_mean_opacity_[i] = o.recv[cnt++];
+      planck_mean_opacity_[i]    = o.recv[cnt++];
+      grid->z[i].n_elec          = o.recv[cnt++];
+      grid->z[i].L_thermal       = o.recv[cnt++];
+      grid->z[i].eps_imc         = o.recv[cnt++];
+      zone_cost_[i]              = o.recv[cnt++];
+      if (!write_rows)
+      {
+        cnt += row - n_opacity_scalars;
+        continue;
+      }
+      for (int k=0;k<nw;k++) abs_opacity_[i][k] = (OpacityType)o.recv[cnt++];
+      for (int k=0;k<nw;k++) emissivity_[i].set(k,(OpacityType)o.recv[cnt++]);
+      if (!omit_scattering_)
+        for (int k=0;k<nw;k++) scat_opacity_[i][k] = (OpacityType)o.recv[cnt++];
+    }
   }
-  MPI_Allreduce(src_MPI_zones,dst_MPI_zones,nz,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-  for (int i=0;i<nz;i++) rosseland_mean_opacity_[i] = dst_MPI_zones[i];
+}
+#endif
 
-  for (int i=0;i<nz;i++)
+//------------------------------------------------------------
+// Complete the sharing of the opacity calculations (and the
+// electron densities, thermal luminosities, implicit MC
+// factors and calculation times) of all zones among the processors. Each processor
+// has calculated only its own block of zones, and started
+// sending them round by round in set_opacity; here we wait
+// for the rounds still in flight
+//------------------------------------------------------------
+void transport::reduce_opacities()
+{
+  phase_timer timer("reduce_opacity");
+#ifdef MPI_PARALLEL
+  while (!opacity_rounds_in_flight_.empty())
   {
-    src_MPI_zones[i] = planck_mean_opacity_[i];
-    dst_MPI_zones[i] = 0.0;
+    finish_opacity_round(opacity_rounds_in_flight_.front());
+    opacity_rounds_in_flight_.pop_front();
   }
-  MPI_Allreduce(src_MPI_zones,dst_MPI_zones,nz,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-  for (int i=0;i<nz;i++) planck_mean_opacity_[i] = dst_MPI_zones[i];
-
+  node_barrier();
 #endif
-
 }
 
 //------------------------------------------------------------
@@ -288,123 +319,90 @@ void transport::reduce_opacities()
  #endif
  }
 
- void transport::reduce_n_elec()
- {
-
-#ifndef MPI_PARALLEL
-  return;
-#else
-
-  if (MPI_nprocs == 1) return;
-
-  //=************************************************
-  // do zone scalar
-  //=************************************************
-  int nz = grid->n_zones;
-  for (int i=0;i<nz;i++)
-  {
-    src_MPI_zones[i] = 0;
-    dst_MPI_zones[i] = 0.0;
-  }
-
-  for (int i=my_zone_start_;i<my_zone_stop_;i++)
-    src_MPI_zones[i] = grid->z[i].n_elec;
-
-  MPI_Allreduce(src_MPI_zones,dst_MPI_zones,nz,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-  for (int i=0;i<nz;i++) grid->z[i].n_elec = dst_MPI_zones[i];
-
-
-#endif
-}
-
- void transport::reduce_Lthermal()
- {
-
-#ifndef MPI_PARALLEL
-  return;
-#else
-
-  if (MPI_nprocs == 1) return;
-  if (params_->getScalar<int>("particles_n_emit_thermal") == 0) return;
-
-  //=************************************************
-  // do zone scalar
-  //=************************************************
-  int nz = grid->n_zones;
-  for (int i=0;i<nz;i++)
-  {
-    src_MPI_zones[i] = 0;
-    dst_MPI_zones[i] = 0.0;
-  }
-  for (int i=my_zone_start_;i<my_zone_stop_;i++)
-    src_MPI_zones[i] = grid->z[i].L_thermal;
-
-  MPI_Allreduce(src_MPI_zones,dst_MPI_zones,nz,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-  for (int i=0;i<nz;i++) grid->z[i].L_thermal = dst_MPI_zones[i];
-#endif
-
- }
-
 //------------------------------------------------------------
 // Combine the radiation tallies in all zones
-// from all processors using MPI
+// from all processors using MPI.  The zone scalars are
+// packed together and reduced in one collective.  The mean
+// intensity J_nu is summed only onto the processor that owns
+// the zone (which needs it for the temperature and NLTE
+// solves) with MPI_Reduce_scatter, then e_rad is shared with
+// all processors and the full J_nu gathered to rank 0 for output
 //------------------------------------------------------------
  void transport::reduce_radiation(double dt)
 {
+  phase_timer timer("reduce_radiation");
+  int nz = grid->n_zones;
 
-#ifndef MPI_PARALLEL
-  return;
-#else
+#ifdef MPI_PARALLEL
   if (MPI_nprocs > 1)
   {
-  // eventually do a smarter reduction
-    int ng = nu_grid_.size();
-    int nz = grid->n_zones;
-    int blocksize = 100000; // transfer around 10 million # per round
-    int nz_per_block = floor(blocksize/ng);
-    if (nz_per_block > nz) nz_per_block = nz;
-    if (nz_per_block < 1)  nz_per_block  = 1;
-
-    // new block size
-    if (store_Jnu_)
-    {
-      blocksize = ng;
-      double *src = new double[blocksize];
-      double *dst = new double[blocksize];
-      for (int i=0;i<nz;i++)
-      {
-        for (int j=0;j<blocksize;j++)
-        {
-        src[j] = J_nu_[i][j];
-        dst[j] = 0.0;
-        }
-        MPI_Allreduce(src,dst,blocksize,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-        for (int j=0;j<blocksize;j++)
-          J_nu_[i][j] = dst[j]/MPI_nprocs;
-      }
-      delete[] src;
-      delete[] dst;
-    }
-
-     //=************************************************
+    //=************************************************
     // do zone scalars
     //=************************************************
+    const int n_scalars = 6;
+    vector<double> src(n_scalars*nz), dst(n_scalars*nz);
+    #pragma omp parallel for schedule(static)
     for (int i=0;i<nz;i++)
     {
-      src_MPI_zones[i] = grid->z[i].e_abs;
-      dst_MPI_zones[i] = 0.0;
+      double *s = &src[n_scalars*i];
+      s[0] = grid->z[i].e_abs;
+      s[1] = grid->z[i].L_radio_dep;
+      s[2] = grid->z[i].fx_rad;
+      s[3] = grid->z[i].fy_rad;
+      s[4] = grid->z[i].fz_rad;
+      s[5] = grid->z[i].fr_rad;
     }
-    MPI_Allreduce(src_MPI_zones,dst_MPI_zones,nz,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    for (int i=0;i<nz;i++) grid->z[i].e_abs = dst_MPI_zones[i]/MPI_nprocs;
-
-
+    MPI_Allreduce(&src[0],&dst[0],n_scalars*nz,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+    #pragma omp parallel for schedule(static)
     for (int i=0;i<nz;i++)
     {
-      src_MPI_zones[i] = grid->z[i].L_radio_dep;
-      dst_MPI_zones[i] = 0.0;
+      double *d = &dst[n_scalars*i];
+      grid->z[i].e_abs       = d[0]/MPI_nprocs;
+      grid->z[i].L_radio_dep = d[1]/MPI_nprocs;
+      grid->z[i].fx_rad      = d[2]/MPI_nprocs;
+      grid->z[i].fy_rad      = d[3]/MPI_nprocs;
+      grid->z[i].fz_rad      = d[4]/MPI_nprocs;
+      grid->z[i].fr_rad      = d[5]/MPI_nprocs;
+    }
+
+    //=************************************************
+    // sum J_nu onto the owners of the zones
+    //=************************************************
+    int nj = J_nu_[0].size();
+    int n_rounds, nz_per_round;
+    radiation_rounds(nj,n_rounds,nz_per_round);
+    vector<int> counts(MPI_nprocs);
+    for (int r=0;r<n_rounds;r++)
+    {
+      // pack every processor's zones for this round in order
+      int n_tot = 0;
+      for (int p=0;p<MPI_nprocs;p++)
+      {
+        int start = zone_block_start_[p] + r*nz_per_round;
+        int stop  = std::min(start + nz_per_round,zone_block_start_[p+1]);
+        counts[p] = std::max(stop - start,0)*nj;
+        n_tot += counts[p];
+      }
+      src.resize(n_tot);
+      dst.resize(counts[MPI_myID]);
+      int cnt = 0;
+      for (int p=0;p<MPI_nprocs;p++)
+      {
+        int start = zone_block_start_[p] + r*nz_per_round;
+        int n_round = counts[p]/nj;
+        #pragma omp parallel for schedule(static)
+        for (int k=0;k<n_round;k++)
+          for (int j=0;j<nj;j++) src[cnt + k*nj + j] = J_nu_[start+k][j];
+        cnt += counts[p];
+      }
+      MPI_Reduce_scatter(&src[0],dst.empty() ? NULL : &dst[0],&counts[0],
+        MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+      int start = my_zone_start_ + r*nz_per_round;
+      int n_round = counts[MPI_myID]/nj;
+      #pragma omp parallel for schedule(static)
+      for (int k=0;k<n_round;k++)
+        for (int j=0;j<nj;j++) J_nu_[start+k][j] = dst[k*nj + j]/MPI_nprocs;
     }
-    MPI_Allreduce(src_MPI_zones,dst_MPI_zones,nz,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
-    for (int i=0;i<nz;i++) grid->z[i].L_radio_dep = dst_MPI_zones[i]/MPI_nprocs;
   }
 #endif
 
@@ -412,7 +410,8 @@ void transport::reduce_opacities()
   // properly normalize the radiative quantities
   // this should really be a separate call
   //=************************************************
-  for (int i=0;i<grid->n_zones;i++)
+  #pragma omp parallel for schedule(static)
+  for (int i=0;i<nz;i++)
   {
     double vol = grid->zone_volume(i);
     grid->z[i].e_abs   /= vol*dt;
@@ -423,7 +422,13 @@ void transport::reduce_opacities()
     //grid->z[i].fx_rad  /= vol*pc::c*dt;
     //grid->z[i].fy_rad  /= vol*pc::c*dt;
     //grid->z[i].fz_rad  /= vol*pc::c*dt;
+  }
 
+  // J_nu is only complete in my zones
+  #pragma omp parallel for schedule(static)
+  for (int i=my_zone_start_;i<my_zone_stop_;i++)
+  {
+    double vol = grid->zone_volume(i);
     if ((nu_grid_.size() == 1)||(!store_Jnu_))
     {
       grid->z[i].e_rad = J_nu_[i][0]/(vol*dt*pc::c);
@@ -439,6 +444,79 @@ void transport::reduce_opacities()
       grid->z[i].e_rad = esum;
     }
   }
+
+#ifdef MPI_PARALLEL
+  if (MPI_nprocs > 1)
+  {
+    //=************************************************
+    // share e_rad, and gather J_nu to rank 0
+    //=************************************************
+    vector<int> counts(MPI_nprocs), displs(MPI_nprocs);
+    for (int p=0;p<MPI_nprocs;p++)
+    {
+      counts[p] = zone_block_start_[p+1] - zone_block_start_[p];
+      displs[p] = zone_block_start_[p];
+    }
+    for (int i=my_zone_start_;i<my_zone_stop_;i++) src_MPI_zones[i] = grid->z[i].e_rad;
+    MPI_Allgatherv(&src_MPI_zones[my_zone_start_],counts[MPI_myID],MPI_DOUBLE,
+      dst_MPI_zones,&counts[0],&displs[0],MPI_DOUBLE,MPI_COMM_WORLD);
+    #pragma omp parallel for schedule(static)
+    for (int i=0;i<nz;i++) grid->z[i].e_rad = dst_MPI_zones[i];
+
+    int nj = J_nu_[0].size();
+    int n_rounds, nz_per_round;
+    radiation_rounds(nj,n_rounds,nz_per_round);
+    vector<double> src, dst;
+    for (int r=0;r<n_rounds;r++)
+    {
+      int n_tot = 0;
+      for (int p=0;p<MPI_nprocs;p++)
+      {
+        int start = zone_block_start_[p] + r*nz_per_round;
+        int stop  = std::min(start + nz_per_round,zone_block_start_[p+1]);
+        counts[p] = std::max(stop - start,0)*nj;
+        displs[p] = n_tot;
+        n_tot += counts[p];
+      }
+      src.resize(counts[MPI_myID]);
+      if (MPI_myID == 0) dst.resize(n_tot);
+      int start = my_zone_start_ + r*nz_per_round;
+      int n_round = counts[MPI_myID]/nj;
+      #pragma omp parallel for schedule(static)
+      for (int k=0;k<n_round;k++)
+        for (int j=0;j<nj;j++) src[k*nj + j] = J_nu_[start+k][j];
+      MPI_Gatherv(src.empty() ? NULL : &src[0],counts[MPI_myID],MPI_DOUBLE,
+        dst.empty() ? NULL : &dst[0],&counts[0],&displs[0],MPI_DOUBLE,0,MPI_COMM_WORLD);
+      if (MPI_myID != 0) continue;
+      for (int p=1;p<MPI_nprocs;p++)
+      {
+        int cnt = displs[p];
+        int start = zone_block_start_[p] + r*nz_per_round;
+        int n_round = counts[p]/nj;
+        #pragma omp parallel for schedule(static)
+        for (int k=0;k<n_round;k++)
+          for (int j=0;j<nj;j++) J_nu_[start+k][j] = dst[cnt + k*nj + j];
+      }
+    }
+  }
+#endif
+}
+
+
+//------------------------------------------------------------
+// Split each processor's block of zones into the rounds in
+// which nj values per zone of J_nu are communicated, keeping
+// the messages below Max_MPI_Blocksize
+//------------------------------------------------------------
+void transport::radiation_rounds(int nj, int &n_rounds, int &nz_per_round) const
+{
+  int max_block = 0;
+  for (int p=0;p<MPI_nprocs;p++)
+    max_block = std::max(max_block,zone_block_start_[p+1] - zone_block_start_[p]);
+  nz_per_round = floor(1.0*Max_MPI_Blocksize/(1.0*nj*MPI_nprocs));
+  if (nz_per_round > max_block) nz_per_round = max_block;
+  if (nz_per_round < 1) nz_per_round = 1;
+  n_rounds = (max_block + nz_per_round - 1)/nz_per_round;
 }
 
 
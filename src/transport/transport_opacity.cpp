@@ -20,6 +20,7 @@ namespace pc = physical_constants;
 //-----------------------------------------------------------------
 void transport::set_opacity(double dt)
 {
+  phase_timer timer("opacity");
 
   double tend,tstr;
   double get_system_time(void);
@@ -27,6 +28,7 @@ void transport::set_opacity(double dt)
   // tmp vector to hold emissivity
   vector<OpacityType> emis(nu_grid_.size());
   vector<OpacityType> scat(nu_grid_.size());
+  vector<OpacityType> abs(nu_grid_.size());
   emis.assign(emis.size(),0.0);
 
   // always do LTE on first step
@@ -37,34 +39,21 @@ void transport::set_opacity(double dt)
     }
   }
 
-  // zero out opacities, etc...
-  for (int i=0;i<grid->n_zones;i++)
-  {
-    compton_opac[i]  = 0;
-    photoion_opac[i] = 0;
-    rosseland_mean_opacity_[i] = 0;
-    planck_mean_opacity_[i]    = 0;
-    emissivity_[i].wipe();
-    for (int j=0;j<nu_grid_.size();j++)
-    {
-      abs_opacity_[i][j] = 0;
-      if (!omit_scattering_) scat_opacity_[i][j] = 0;
-    }
-  }
-
-
   if (verbose)
     if (solve_Tgas_with_updated_opacities_ && first_step_ == 0)
       printf("# Solving coupled equations for gas state and temperature\n");
 
 
+  // don't overwrite node-shared opacities still being read
+  node_barrier();
+
   // loop over my zones to calculate
   // loop to parallelize with OpenMP
   tstr = get_system_time();
   int solve_root_errors = 0;
   int solve_iter_errors = 0;
 
-#pragma omp parallel firstprivate(emis, scat) shared(cerr,solve_root_errors,solve_iter_errors) default(none)
+#pragma omp parallel firstprivate(emis, scat, abs) shared(cerr,solve_root_errors,solve_iter_errors,dt) default(none)
   {
 #ifdef _OPENMP
     int my_threadID = omp_get_thread_num();
@@ -79,127 +68,177 @@ void transport::set_opacity(double dt)
     int solve_error = 0;
 
 
+    // do my zones in rounds, sending off each finished round
+    // while the next is calculated
+    for (int r=0;r<n_opacity_rounds_;r++)
+    {
+      int zone_start, zone_stop;
+      opacity_round_zones(r,MPI_myID,zone_start,zone_stop);
+
 #pragma omp for
-    for (int i=my_zone_start_;i<my_zone_stop_;i++) {
-      // pointer to current zone for easy access
-      zone* z = &(grid->z[i]);
-
-      //------------------------------------------------------
-      // calculate optical photon opacities
-      //------------------------------------------------------
-
-      // set up the state of the gas in this zone
-      gas_state_ptr->dens_ = z->rho;
-      gas_state_ptr->temp_ = z->T_gas;
-      gas_state_ptr->time_ = t_now_;
-      if (gas_state_ptr->temp_ < temp_min_value_) gas_state_ptr->temp_ = temp_min_value_;
-      if (gas_state_ptr->temp_ > temp_max_value_) gas_state_ptr->temp_ = temp_max_value_;
-
-      // radioactive decay the composition
-      for (size_t j=0;j<X_now.size();j++) X_now[j] = z->X_gas[j];
-      if (!omit_composition_decay_) {
-        radio->decay_composition(grid->elems_Z,grid->elems_A,X_now,t_now_);
-      }
+      for (int i=zone_start;i<zone_stop;i++) {
+        // pointer to current zone for easy access
+        zone* z = &(grid->z[i]);
 
-      gas_state_ptr->set_mass_fractions(X_now);
+        //------------------------------------------------------
+        // calculate optical photon opacities
+        //------------------------------------------------------
 
-      gas_state_ptr->bulk_grey_opacity_ = z->bulk_grey_opacity;
-      gas_state_ptr->total_grey_opacity_ = z->total_grey_opacity;
+        // time the work of this zone, for balancing the ranks
+        double t_zone = get_system_time();
 
-      if (first_step_)
-      {
-        zone* z = &(grid->z[i]);
+        // set up the state of the gas in this zone
         gas_state_ptr->dens_ = z->rho;
         gas_state_ptr->temp_ = z->T_gas;
-
-        if (gas_state_ptr->total_grey_opacity_ == 0)
-        {
-          // always do LTE on first step, without updating temperature
-          solve_error = gas_state_ptr->solve_state();
+        gas_state_ptr->time_ = t_now_;
+        if (gas_state_ptr->temp_ < temp_min_value_) gas_state_ptr->temp_ = temp_min_value_;
+        if (gas_state_ptr->temp_ > temp_max_value_) gas_state_ptr->temp_ = temp_max_value_;
+
+        // radioactive decay the composition
+        for (size_t j=0;j<X_now.size();j++) X_now[j] = z->X_gas[j];
+        if (!omit_composition_decay_) {
+          radio->decay_composition(grid->elems_Z,grid->elems_A,X_now,t_now_);
         }
-      }
 
-      else
-      {
-        if (solve_Tgas_with_updated_opacities_)
+        gas_state_ptr->set_mass_fractions(X_now);
+
+        gas_state_ptr->bulk_grey_opacity_ = z->bulk_grey_opacity;
+        gas_state_ptr->total_grey_opacity_ = z->total_grey_opacity;
+
+        if (first_step_)
         {
-          // gas state solution (LTE or NLTE) solution as well as radiative
-          // equilibrium temperature solve will happen here
-          solve_error = solve_state_and_temperature(gas_state_ptr, i);
+          zone* z = &(grid->z[i]);
+          gas_state_ptr->dens_ = z->rho;
+          gas_state_ptr->temp_ = z->T_gas;
+
+          if (gas_state_ptr->total_grey_opacity_ == 0)
+          {
+            // always do LTE on first step, without updating temperature
+            solve_error = gas_state_ptr->solve_state();
+          }
         }
 
         else
         {
-          if (gas_state_ptr->total_grey_opacity_ == 0)
+          if (solve_Tgas_with_updated_opacities_)
           {
-            solve_error = gas_state_ptr->solve_state(J_nu_[i]);
+            // gas state solution (LTE or NLTE) solution as well as radiative
+            // equilibrium temperature solve will happen here
+            solve_error = solve_state_and_temperature(gas_state_ptr, i);
+          }
+
+          else
+          {
+            if (gas_state_ptr->total_grey_opacity_ == 0)
+            {
+              solve_error = gas_state_ptr->solve_state(J_nu_[i]);
+            }
           }
         }
-      }
 
-      if (solve_error == 1) solve_root_errors += 1;
-      if (solve_error == 2) solve_iter_errors += 1;
+        if (solve_error == 1) solve_root_errors += 1;
+        if (solve_error == 2) solve_iter_errors += 1;
 
-      //gas_state_ptr->print();
-      #pragma omp critical
-      if(write_levels) gas_state_ptr->write_levels(i);
+        //gas_state_ptr->print();
+        if (write_levels)
+        {
+          levels_thread_[my_threadID].push_back(std::make_pair(i,vector<double>()));
+          gas_state_ptr->get_levels(levels_thread_[my_threadID].back().second);
+        }
 
-      grid->z[i].n_elec = gas_state_ptr->n_elec_;
+        grid->z[i].n_elec = gas_state_ptr->n_elec_;
 
-      // calculate the opacities/emissivities
-      gas_state_ptr->computeOpacity(abs_opacity_[i],scat,emis);
+        // calculate the opacities/emissivities
+        gas_state_ptr->computeOpacity(abs,scat,emis);
+        zone_cost_[i] = get_system_time() - t_zone;
 
-      double max_extinction = maximum_opacity_* z->rho;
+        double max_extinction = maximum_opacity_* z->rho;
 
-      // save and normalize emissivity cdf
-      grid->z[i].L_thermal = 0;
-      if (nu_grid_.size() == 1)
-      {
-        double bb_int = pc::sb*pow(grid->z[i].T_gas,4)/pc::pi;
-        grid->z[i].L_thermal += 4*pc::pi*abs_opacity_[i][0]*bb_int;
-        emissivity_[i].set_value(0,1);
-        if (!omit_scattering_) scat_opacity_[i][0] = scat[0];
-      }
-      else for (int j=0;j<nu_grid_.size();j++)
-      {
-        double ednu = emis[j]*nu_grid_.delta(j);
-        emissivity_[i].set_value(j,ednu);
-        grid->z[i].L_thermal += 4*pc::pi * ednu;
-        if (!omit_scattering_) scat_opacity_[i][j] = scat[j];
+        // save and normalize emissivity cdf
+        grid->z[i].L_thermal = 0;
+        if (nu_grid_.size() == 1)
+        {
+          double bb_int = pc::sb*pow(grid->z[i].T_gas,4)/pc::pi;
+          grid->z[i].L_thermal += 4*pc::pi*abs[0]*bb_int;
+          emissivity_[i].set_value(0,1);
+        }
+        else for (int j=0;j<nu_grid_.size();j++)
+        {
+          double ednu = emis[j]*nu_grid_.delta(j);
+          emissivity_[i].set_value(j,ednu);
+          grid->z[i].L_thermal += 4*pc::pi * ednu;
+
+          // check for maximum opacity
+          if (scat[j] > max_extinction) scat[j] = max_extinction;
+          if (abs[j]  > max_extinction) abs[j]  = max_extinction;
+        }
+        emissivity_[i].normalize();
+
+        // store the opacities of the zone
+        abs_opacity_.set_row(i,abs);
+        if (!omit_scattering_) scat_opacity_.set_row(i,scat);
+        else scat.assign(scat.size(),0.0);
+
+        // calculate mean opacities
+        planck_mean_opacity_[i] =
+          gas_state_ptr->get_planck_mean(abs,scat);
+        rosseland_mean_opacity_[i] =
+          gas_state_ptr->get_rosseland_mean(abs,scat);
+
+        //------------------------------------------------------
+        // gamma-ray opacity (compton + photo-electric)
+        //------------------------------------------------------
+        compton_opac[i]  = 0;
+        photoion_opac[i] = 0;
+        for (int k=0;k<grid->n_elems;k++)
+        {
+          double dens  = z->X_gas[k]*z->rho;
+          double ndens = dens/(pc::m_p*grid->elems_A[k]);
+          // compton scattering opacity
+          compton_opac[i] += ndens*pc::thomson_cs*grid->elems_Z[k];
+          // photoelectric opacity
+          double photo = pow(pc::alpha_fs,4.0)*4.0*sqrt(2.0);
+          photo *= pow(1.0*grid->elems_Z[k],5.0);
+          photo *= pow(pc::m_e_MeV,3.5);
+          photoion_opac[i] += ndens*2.0*pc::thomson_cs*photo;
+        }
 
-        // check for maximum opacity
-        if (!omit_scattering_)
+        //------------------------------------------------------
+        // implicit monte carlo factor
+        //------------------------------------------------------
+        if (radiative_eq)
         {
-          if (scat_opacity_[i][j] > max_extinction)
-            scat_opacity_[i][j]   = max_extinction;
+          z->eps_imc = 1.;
         }
-        if (abs_opacity_[i][j]  > max_extinction)
-          abs_opacity_[i][j]    = max_extinction;
+        else
+        {
+          // Not distinguishing between lab frame density and comoving frame density
+          double fleck_beta  = 4.0*pc::a*pow(z->T_gas,4)/(z->e_gas*z->rho);
+          // here planck mean opac has units cm^-1 .
+          // When grey opacity is used, planck_mean_opacity should just be the correct grey opacity
+          double tfac = pc::c*planck_mean_opacity_[i]*dt;
+          double f_imc = fleck_alpha_*fleck_beta*tfac;
+
+          // make sure to avoid divide by zero if fleck alpha is zero and not computing e_gas through hydro
+          if (fleck_alpha_ == 0)
+            f_imc = 0.;
+
+          z->eps_imc = 1.0/(1.0 + f_imc);
+        }
+      }
+
+      // the omp for ends with a barrier, so this round is done
+      if (mpi_funneled_)
+      {
+        #pragma omp master
+        send_opacity_round(r);
       }
-      emissivity_[i].normalize();
-
-      // calculate mean opacities
-      planck_mean_opacity_[i] =
-        gas_state_ptr->get_planck_mean(abs_opacity_[i],scat_opacity_[i]);
-      rosseland_mean_opacity_[i] =
-        gas_state_ptr->get_rosseland_mean(abs_opacity_[i],scat_opacity_[i]);
-
-      //------------------------------------------------------
-      // gamma-ray opacity (compton + photo-electric)
-      //------------------------------------------------------
-      compton_opac[i]  = 0;
-      photoion_opac[i] = 0;
-      for (int k=0;k<grid->n_elems;k++)
+
+      // write out the level data of the round
+      if (write_levels)
       {
-        double dens  = z->X_gas[k]*z->rho;
-        double ndens = dens/(pc::m_p*grid->elems_A[k]);
-        // compton scattering opacity
-        compton_opac[i] += ndens*pc::thomson_cs*grid->elems_Z[k];
-        // photoelectric opacity
-        double photo = pow(pc::alpha_fs,4.0)*4.0*sqrt(2.0);
-        photo *= pow(1.0*grid->elems_Z[k],5.0);
-        photo *= pow(pc::m_e_MeV,3.5);
-        photoion_opac[i] += ndens*2.0*pc::thomson_cs*photo;
+        #pragma omp single
+        flush_levels();
       }
     }
 
@@ -214,43 +253,20 @@ void transport::set_opacity(double dt)
     }
   }
   // end OpenMP parallel region
+
+  // without MPI thread support, the rounds are sent once all
+  // are done, outside of the parallel region
+  if (!mpi_funneled_)
+    for (int r=0;r<n_opacity_rounds_;r++) send_opacity_round(r);
  
   if (solve_Tgas_with_updated_opacities_ && first_step_ == 0) {
     reduce_Tgas(); }
 
 
-  reduce_n_elec();
-
   tend = get_system_time();
   if (verbose) cout << "# Calculated opacities   (" << (tend-tstr) << " secs) \n";
 
 
-  //------------------------------------------------------------
-  // Calcuate implicit MC parameter eps_imc
-  //------------------------------------------------------------
-  for (int i=0;i<grid->n_zones;i++)
-  {
-    if (radiative_eq)
-    {
-      grid->z[i].eps_imc = 1.;
-    }
-    else
-    {
-      // Not distinguishing between lab frame density and comoving frame density
-      double fleck_beta  = 4.0*pc::a*pow(grid->z[i].T_gas,4)/(grid->z[i].e_gas*grid->z[i].rho);
-      // here planck mean opac has units cm^-1 .
-      // When grey opacity is used, planck_mean_opacity should just be the correct grey opacity
-      double tfac = pc::c*planck_mean_opacity_[i]*dt;
-      double f_imc = fleck_alpha_*fleck_beta*tfac;
-
-      // make sure to avoid divide by zero if fleck alpha is zero and not computing e_gas through hydro
-      if (fleck_alpha_ == 0)
-        f_imc = 0.;
-
-      grid->z[i].eps_imc = 1.0/(1.0 + f_imc);
-    }
-  }
-
   // turn nlte back on after first step, if wanted
   if (first_step_) {
     for (auto i_gas_state = gas_state_vec_.begin(); i_gas_state != gas_state_vec_.end(); i_gas_state++) {
@@ -260,6 +276,22 @@ void transport::set_opacity(double dt)
 }
 
 
+//-----------------------------------------------------------------
+// write the level data buffered by each thread to the zone
+// files (one thread at a time, as hdf5 is not thread safe),
+// and clear the buffers
+//-----------------------------------------------------------------
+void transport::flush_levels()
+{
+  for (size_t t=0;t<levels_thread_.size();t++)
+  {
+    for (size_t k=0;k<levels_thread_[t].size();k++)
+      gas_state_vec_[0].write_levels(levels_thread_[t][k].first,levels_thread_[t][k].second);
+    levels_thread_[t].clear();
+  }
+}
+
+
 //-----------------------------------------------------------------
 // get comoving opacity at the frequency
 // returns the frequency index of the photon in the
@@ -278,9 +310,9 @@ int transport::get_opacity(particle &p, double dshift, double &opac, double &eps
   {
     // interpolate opacity at the local comving frame frequency
     i_nu = nu_grid_.locate_within_bounds(nu);
-    double a_opac = nu_grid_.value_at(nu,abs_opacity_[p.ind],i_nu);
+    double a_opac = abs_opacity_[p.ind][i_nu];
     double s_opac = 0;
-    if (!omit_scattering_) s_opac = nu_grid_.value_at(nu,scat_opacity_[p.ind],i_nu);
+    if (!omit_scattering_) s_opac = scat_opacity_[p.ind][i_nu];
     opac = a_opac + s_opac;
     if (opac == 0) eps = 0;
     else eps  = a_opac/opac;
@@ -289,10 +321,7 @@ int transport::get_opacity(particle &p, double dshift, double &opac, double &eps
   // get opacity if it is a gamma-ray
   if (p.type == gammaray)
   {
-    double c_opac = compton_opac[p.ind]*klein_nishina(p.nu);
-    double p_opac = photoion_opac[p.ind]*pow(p.nu,-3.5);
-    opac = c_opac + p_opac;
-    eps  = p_opac/(c_opac + p_opac);
+    get_gamma_opacity(p.ind,p.nu,opac,eps);
   }
 
   return i_nu;
@@ -16,6 +16,7 @@ namespace pc = physical_constants;
 //--------------------------------------------------------------
 void transport::output_spectrum(int it)
 {
+  phase_timer timer("spectrum_output");
 
   std::stringstream ss;
   if (it < 0)  ss << "_final";
@@ -69,6 +70,7 @@ void transport::output_spectrum()
 
 void transport::write_levels_to_plotfile(int iw)
 {
+  phase_timer timer("levels_output");
   char pltfile[1000];
   sprintf(pltfile,"plt_%05d.h5",iw);
 
@@ -144,6 +146,7 @@ void transport::write_levels_to_plotfile(int iw)
 //------------------------------------------------------------
 void transport::write_radiation_file(int iw)
 {
+  phase_timer timer("radiation_output");
   // get file name
   char zonefile[1000];
   sprintf(zonefile,"plt_%05d.h5",iw);
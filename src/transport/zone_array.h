@@ -0,0 +1,104 @@
+#ifndef _ZONE_ARRAY_H
+#define _ZONE_ARRAY_H 1
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include "cdf_array.h"
+#include "large_array.h"
+
+//**********************************************************
+// A frequency dependent quantity in every zone, stored
+// contiguously as n_zones rows of n_freq values. The memory
+// is either owned by the array, or attached from outside
+// (e.g. a segment of memory shared by all ranks on a node)
+//
+// Owned memory comes from large_array_allocate, so the rows
+// of the zones are first touched by the threads that work on
+// them (and may be backed by huge pages)
+//
+// a[i] returns a pointer to the row of zone i, so elements
+// are accessed as a[i][j]
+//**********************************************************
+
+template <class T> class zone_array
+{
+
+protected:
+
+  T *own_;
+  T *data_;
+  int nz_, nf_;
+
+public:
+
+  zone_array() : own_(NULL), data_(NULL), nz_(0), nf_(0) {}
+  ~zone_array() {free(own_);}
+
+  // copies would point at the memory of the original
+  zone_array(const zone_array&) = delete;
+  zone_array& operator=(const zone_array&) = delete;
+
+  //------------------------------------------------------
+  // allocate (owned) memory for nz zones of nf values
+  //------------------------------------------------------
+  void resize(const int nz, const int nf)
+  {
+    free(own_);
+    own_  = (T*)large_array_allocate(nz,(size_t)nf*sizeof(T));
+    data_ = own_;
+    nz_ = nz;
+    nf_ = nf;
+  }
+
+  //------------------------------------------------------
+  // use the memory at data, which must hold nz*nf values
+  // and outlive the array
+  //------------------------------------------------------
+  void attach(T *data, const int nz, const int nf)
+  {
+    free(own_);
+    own_  = NULL;
+    data_ = data;
+    nz_ = nz;
+    nf_ = nf;
+  }
+
+  T*       operator[](const int i)       {return data_ + (size_t)i*nf_;}
+  const T* operator[](const int i) const {return data_ + (size_t)i*nf_;}
+
+  //------------------------------------------------------
+  // copy a vector of nf values into the row of zone i
+  //------------------------------------------------------
+  void set_row(const int i, const std::vector<T>& v)
+  {
+    std::copy(v.begin(),v.begin()+nf_,(*this)[i]);
+  }
+
+  int n_zones() const {return nz_;}
+  int n_freq()  const {return nf_;}
+};
+
+
+//**********************************************************
+// A zone_array whose rows are CDFs, so that a[i] can be
+// used like a cdf_array
+//**********************************************************
+
+template <class T> class cdf_zone_array : public zone_array<T>
+{
+
+public:
+
+  cdf_view<T> operator[](const int i)
+  {
+    return cdf_view<T>(zone_array<T>::operator[](i),this->nf_);
+  }
+
+  const cdf_view<T> operator[](const int i) const
+  {
+    return cdf_view<T>(const_cast<T*>(zone_array<T>::operator[](i)),this->nf_);
+  }
+};
+
+#endif
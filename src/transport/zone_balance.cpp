@@ -0,0 +1,88 @@
+//------------------------------------------------------------
+// zone_balance.cpp
+// This file contains the (optional) balancing of the opacity
+// and NLTE work among the MPI ranks.  The time each zone took
+// in set_opacity is shared along with its opacities, and the
+// zones are redrawn into contiguous blocks of about equal
+// total time, which are used from the next step on
+//------------------------------------------------------------
+
+#include <iostream>
+#include <algorithm>
+#include "transport.h"
+
+using std::cout;
+
+
+//------------------------------------------------------------
+// Report the spread of the opacity work among the ranks, and
+// if it is too uneven redraw the zone blocks so that each
+// rank's zones took about the same time this step
+//------------------------------------------------------------
+void transport::balance_zones()
+{
+  phase_timer timer("balance_zones");
+  if (MPI_nprocs == 1) return;
+  int nz = grid->n_zones;
+
+  // time taken by each rank for its block of zones
+  vector<double> rank_cost(MPI_nprocs,0);
+  double total = 0;
+  for (int p=0;p<MPI_nprocs;p++)
+  {
+    for (int i=zone_block_start_[p];i<zone_block_start_[p+1];i++)
+      rank_cost[p] += zone_cost_[i];
+    total += rank_cost[p];
+  }
+  if (total <= 0) return;
+
+  int p_max = 0;
+  for (int p=1;p<MPI_nprocs;p++)
+    if (rank_cost[p] > rank_cost[p_max]) p_max = p;
+  double mean = total/MPI_nprocs;
+  double imbalance = rank_cost[p_max]/mean;
+
+  if (verbose)
+    cout << "# Opacity work imbalance (max/mean rank time) = " << imbalance <<
+      " (rank " << p_max << ", " << rank_cost[p_max] << " secs)\n";
+
+  if (!zone_balance_) return;
+  if (imbalance < zone_balance_tolerance_) return;
+
+  // cut the cumulative cost into equal parts, keeping at
+  // least one zone on every rank
+  vector<double> cum_cost(nz+1,0);
+  for (int i=0;i<nz;i++) cum_cost[i+1] = cum_cost[i] + zone_cost_[i];
+
+  int i = 0;
+  for (int p=1;p<MPI_nprocs;p++)
+  {
+    double target = total*p/MPI_nprocs;
+    while ((i < nz)&&(cum_cost[i+1] <= target)) i++;
+    if ((i < nz)&&(cum_cost[i+1] - target < target - cum_cost[i])) i++;
+
+    int lo = zone_block_start_[p-1] + 1;
+    int hi = nz - (MPI_nprocs - p);
+    if (i > hi) i = hi;
+    if (i < lo) i = lo;
+    if (i > nz) i = nz;
+    zone_block_start_[p] = i;
+  }
+  my_zone_start_ = zone_block_start_[MPI_myID];
+  my_zone_stop_  = zone_block_start_[MPI_myID+1];
+
+  // the rounds depend on the largest block
+  setup_opacity_rounds(opacity_pipeline_blocks_);
+
+  if (verbose)
+  {
+    double max_cost = 0;
+    for (int p=0;p<MPI_nprocs;p++)
+    {
+      int start = zone_block_start_[p], stop = zone_block_start_[p+1];
+      max_cost = std::max(max_cost,cum_cost[stop] - cum_cost[start]);
+    }
+    cout << "# Rebalanced zone blocks (predicted max/mean rank time = " <<
+      max_cost/mean << ")\n";
+  }
+}
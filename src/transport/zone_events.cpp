@@ -0,0 +1,99 @@
+//------------------------------------------------------------
+// zone_events.cpp
+// This file contains the (optional) counting of propagation
+// events in each zone: scatterings, zone and frequency bin
+// crossings, and discrete diffusion and random walk steps.
+// Threads count into their own buffers, which are summed over
+// the threads and ranks after every step, and the sums since
+// the last plotfile are written to the next one, along with
+// the time taken by the opacities of each zone
+//------------------------------------------------------------
+
+#include "transport.h"
+
+
+//------------------------------------------------------------
+// allocate the counters of each thread, if counting
+//------------------------------------------------------------
+void transport::setup_zone_events()
+{
+  count_zone_events_ = params_->getScalar<int>("output_write_event_counts");
+  if (!count_zone_events_) return;
+
+#ifdef _OPENMP
+  int max_nthreads = omp_get_max_threads();
+#else
+  int max_nthreads = 1;
+#endif
+  int n = n_zone_event_types*grid->n_zones;
+  zone_events_thread_.assign(max_nthreads*n,0);
+  zone_events_.assign(n,0);
+}
+
+
+//------------------------------------------------------------
+// Add the counts of all threads and ranks to the sums kept on
+// rank 0, and clear them
+//------------------------------------------------------------
+void transport::reduce_zone_events()
+{
+  if (!count_zone_events_) return;
+  int n  = zone_events_.size();
+  int nt = zone_events_thread_.size()/n;
+
+  vector<double> send(n,0);
+  #pragma omp parallel for
+  for (int k=0;k<n;k++)
+  {
+    for (int t=0;t<nt;t++)
+    {
+      send[k] += zone_events_thread_[t*n + k];
+      zone_events_thread_[t*n + k] = 0;
+    }
+  }
+
+#ifdef MPI_PARALLEL
+  vector<double> recv(n,0);
+  MPI_Reduce(&send[0],&recv[0],n,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
+  send.swap(recv);
+#endif
+  if (verbose)
+    for (int k=0;k<n;k++) zone_events_[k] += send[k];
+}
+
+
+//------------------------------------------------------------
+// Add the event counts since the last plotfile, and the time
+// of the opacity calculation of each zone, to a plotfile
+// assumes that the pltfile has already been created
+//------------------------------------------------------------
+void transport::write_zone_events_to_plotfile(int iw)
+{
+  if (!count_zone_events_) return;
+
+  char zonefile[1000];
+  sprintf(zonefile,"plt_%05d.h5",iw);
+  hid_t file_id = H5Fopen( zonefile, H5F_ACC_RDWR, H5P_DEFAULT);
+  const int RANK = 1;
+
+  const char *names[n_zone_event_types] =
+    {"n_scatter","n_zone_cross","n_nu_cross","n_ddmc","n_walk"};
+
+  int nz = grid->n_zones;
+  float* tz_array = new float[nz];
+  hsize_t  dims_z[RANK]={(hsize_t)nz};
+
+  for (int e=0;e<n_zone_event_types;e++)
+  {
+    for (int i=0;i<nz;i++) tz_array[i] = zone_events_[e*nz + i];
+    H5LTmake_dataset(file_id,names[e],RANK,dims_z,H5T_NATIVE_FLOAT,tz_array);
+  }
+  for (int i=0;i<nz;i++) tz_array[i] = zone_cost_[i];
+  H5LTmake_dataset(file_id,"opacity_time",RANK,dims_z,H5T_NATIVE_FLOAT,tz_array);
+  delete[] tz_array;
+
+  H5Fclose(file_id);
+
+  // start counting again for the next plotfile
+  zone_events_.assign(zone_events_.size(),0);
+}
@@ -0,0 +1,95 @@
+#ifndef _LARGE_ARRAY_H
+#define _LARGE_ARRAY_H 1
+
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <sys/mman.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//**********************************************************
+// Allocation of the large per-zone arrays (the zones, and
+// the opacities and emissivities).  The memory is zeroed by
+// all threads, each taking the block of elements it would
+// get in a schedule(static) loop, so that pages are placed
+// (first touched) on the NUMA node of the thread that works
+// on those zones.  Arrays of at least one huge page can be
+// aligned to 2 MB and advised to use transparent huge pages,
+// to cut the TLB misses of random zone access
+//**********************************************************
+
+static const size_t huge_page_size = 2*1024*1024;
+
+//---------------------------------------------------------
+// whether to back large arrays with huge pages (set from
+// the parameters before the grid is allocated)
+//---------------------------------------------------------
+inline int& large_array_huge_pages()
+{
+  static int use_huge_pages = 0;
+  return use_huge_pages;
+}
+
+//---------------------------------------------------------
+// allocate and first touch n elements of elem_size bytes
+// (free the memory with free())
+//---------------------------------------------------------
+inline void* large_array_allocate(size_t n, size_t elem_size)
+{
+  size_t bytes = n*elem_size;
+  if (bytes == 0) return NULL;
+
+  void *ptr = NULL;
+  if ((large_array_huge_pages())&&(bytes >= huge_page_size))
+  {
+    size_t alloc = ((bytes + huge_page_size - 1)/huge_page_size)*huge_page_size;
+    if (posix_memalign(&ptr,huge_page_size,alloc) != 0) ptr = NULL;
+#ifdef MADV_HUGEPAGE
+    if (ptr) madvise(ptr,alloc,MADV_HUGEPAGE);
+#endif
+  }
+  else
+    ptr = malloc(bytes);
+  if (ptr == NULL) throw std::bad_alloc();
+
+  char *c = (char*)ptr;
+  #pragma omp parallel
+  {
+#ifdef _OPENMP
+    size_t nt = omp_get_num_threads();
+    size_t t  = omp_get_thread_num();
+#else
+    size_t nt = 1, t = 0;
+#endif
+    size_t start = n*t/nt;
+    size_t stop  = n*(t+1)/nt;
+    memset(c + start*elem_size,0,(stop - start)*elem_size);
+  }
+  return ptr;
+}
+
+
+//**********************************************************
+// std allocator using the above, e.g. for std::vector
+//**********************************************************
+
+template <class T> struct large_array_allocator
+{
+  typedef T value_type;
+
+  large_array_allocator() {}
+  template <class U> large_array_allocator(const large_array_allocator<U>&) {}
+
+  T* allocate(size_t n) {return (T*)large_array_allocate(n,sizeof(T));}
+  void deallocate(T* p, size_t) {free(p);}
+};
+
+template <class T, class U>
+bool operator==(const large_array_allocator<T>&, const large_array_allocator<U>&) {return true;}
+template <class T, class U>
+bool operator!=(const large_array_allocator<T>&, const large_array_allocator<U>&) {return false;}
+
+#endif
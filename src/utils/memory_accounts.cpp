@@ -0,0 +1,185 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include "sedona.h"
+#include "memory_accounts.h"
+
+#ifdef MPI_PARALLEL
+#include <mpi.h>
+#endif
+
+using std::string;
+using std::vector;
+
+static const double MB = 1024.0*1024.0;
+
+static int rank_number()
+{
+  int my_rank = 0;
+#ifdef MPI_PARALLEL
+  MPI_Comm_rank(MPI_COMM_WORLD,&my_rank);
+#endif
+  return my_rank;
+}
+
+
+//---------------------------------------------------------
+// Set the limit on the memory of a rank (in MB; 0 for no
+// limit), and whether going over it exits
+//---------------------------------------------------------
+void memory_account_set::init(double limit_mb, int abort, int verbose)
+{
+  limit_   = (limit_mb > 0) ? limit_mb*MB : 0;
+  abort_   = abort;
+  verbose_ = verbose;
+}
+
+
+//---------------------------------------------------------
+// Set the bytes held by the account called name (adding it
+// if new), and the bytes it may grow to.  Call this before
+// allocating them, so that a rank that would go over the
+// limit can stop first
+//---------------------------------------------------------
+void memory_account_set::set(const string &name, double bytes, double projected)
+{
+  std::map<string,int>::iterator it = index_.find(name);
+  int i;
+  if (it != index_.end()) i = it->second;
+  else
+  {
+    account a;
+    a.name = name;
+    a.bytes = 0;
+    a.projected = 0;
+    accounts_.push_back(a);
+    i = accounts_.size() - 1;
+    index_[name] = i;
+  }
+
+  projected = std::max(projected,bytes);
+  total_     += bytes - accounts_[i].bytes;
+  projected_ += projected - accounts_[i].projected;
+  accounts_[i].bytes = bytes;
+  accounts_[i].projected = projected;
+  peak_ = std::max(peak_,total_);
+  check_limit(name);
+}
+
+
+//---------------------------------------------------------
+// Warn (once each time it goes over) or exit if this rank
+// is over the limit (aborting all ranks, as the others may
+// be waiting on this one)
+//---------------------------------------------------------
+void memory_account_set::check_limit(const string &name)
+{
+  if (limit_ <= 0) return;
+  if (total_ <= limit_) {over_ = 0; return;}
+  if ((over_)&&(!abort_)) return;
+
+  std::cerr << "# " << (abort_ ? "ERROR" : "WARNING") << ": " << name << " brings rank "
+    << rank_number() << " to " << total_/MB << " MB of memory, over run_memory_limit = "
+    << limit_/MB << " MB";
+  if (abort_)
+  {
+    std::cerr << "; exiting" << std::endl;
+#ifdef MPI_PARALLEL
+    MPI_Abort(MPI_COMM_WORLD,1);
+#endif
+    exit(1);
+  }
+  std::cerr << std::endl;
+  over_ = 1;
+}
+
+
+//---------------------------------------------------------
+// The resident memory and its high-water mark, from the
+// VmRSS and VmHWM lines of /proc/self/status (in kB)
+//---------------------------------------------------------
+void memory_account_set::resident(double &rss, double &hwm)
+{
+  rss = 0;
+  hwm = 0;
+  FILE *f = fopen("/proc/self/status","r");
+  if (f == NULL) return;
+  char line[256];
+  double kb;
+  while (fgets(line,sizeof(line),f))
+  {
+    if (sscanf(line,"VmRSS: %lf",&kb) == 1) rss = kb*1024;
+    if (sscanf(line,"VmHWM: %lf",&kb) == 1) hwm = kb*1024;
+  }
+  fclose(f);
+}
+
+
+//---------------------------------------------------------
+// Print each account (the most held by a rank, and the sum
+// over the ranks) now and projected, and the resident
+// memory, warning if the projection of a rank is over the
+// limit
+//---------------------------------------------------------
+void memory_account_set::report(const char *title)
+{
+  // bytes and projected bytes of each account, then the
+  // totals and the resident memory and its high-water mark
+  int n = accounts_.size();
+  vector<double> mine(2*n+4);
+  for (int k=0;k<n;k++)
+  {
+    mine[2*k]   = accounts_[k].bytes;
+    mine[2*k+1] = accounts_[k].projected;
+  }
+  mine[2*n]   = total_;
+  mine[2*n+1] = projected_;
+  resident(mine[2*n+2],mine[2*n+3]);
+
+  vector<double> hi = mine, sum = mine;
+#ifdef MPI_PARALLEL
+  MPI_Reduce(&mine[0],&hi[0],2*n+4,MPI_DOUBLE,MPI_MAX,0,MPI_COMM_WORLD);
+  MPI_Reduce(&mine[0],&sum[0],2*n+4,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
+#endif
+  if (!verbose_) return;
+
+  printf("# Memory (MB) %-22s  rank max  all ranks   projected: rank max  all ranks\n",title);
+  for (int k=0;k<n+1;k++)
+  {
+    const char *name = (k < n) ? accounts_[k].name.c_str() : "total";
+    printf("#   %-32s %10.1f %10.1f %20.1f %10.1f\n",name,hi[2*k]/MB,sum[2*k]/MB,
+      hi[2*k+1]/MB,sum[2*k+1]/MB);
+  }
+  printf("#   %-32s %10.1f %10.1f\n","resident (VmRSS)",hi[2*n+2]/MB,sum[2*n+2]/MB);
+  printf("#   %-32s %10.1f %10.1f\n","resident high-water (VmHWM)",hi[2*n+3]/MB,sum[2*n+3]/MB);
+
+  if ((limit_ > 0)&&(hi[2*n+1] > limit_))
+    std::cout << "# WARNING: a rank may need " << hi[2*n+1]/MB <<
+      " MB, over run_memory_limit = " << limit_/MB << " MB\n";
+}
+
+
+//---------------------------------------------------------
+// Print one line with the accounted and resident memory of
+// the largest rank, now and at its high-water mark
+//---------------------------------------------------------
+void memory_account_set::report_step(int step)
+{
+  double mine[4];
+  mine[0] = total_;
+  mine[1] = peak_;
+  resident(mine[2],mine[3]);
+
+  double hi[4] = {mine[0],mine[1],mine[2],mine[3]};
+  double sum = total_;
+#ifdef MPI_PARALLEL
+  MPI_Reduce(mine,hi,4,MPI_DOUBLE,MPI_MAX,0,MPI_COMM_WORLD);
+  MPI_Reduce(&total_,&sum,1,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
+#endif
+  if (!verbose_) return;
+
+  printf("# Memory (MB) after step %d, largest rank: accounted %.1f (peak %.1f), ",step,
+    hi[0]/MB,hi[1]/MB);
+  printf("resident %.1f (peak %.1f); accounted on all ranks %.1f\n",hi[2]/MB,hi[3]/MB,sum/MB);
+}
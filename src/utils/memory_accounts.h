@@ -0,0 +1,78 @@
+#ifndef _MEMORY_ACCOUNTS_H
+#define _MEMORY_ACCOUNTS_H 1
+
+#include <string>
+#include <vector>
+#include <map>
+
+//**********************************************************
+// Accounts of the memory held by the subsystems of a rank
+// (opacities, radiation field, particles, spectra, atomic
+// data...).  Each subsystem sets the bytes of its major
+// arrays before it allocates them, and may give the most
+// they can grow to (e.g. the particle bank at its maximum
+// size), so the projected memory of a run is known before
+// the first step.  If a per rank limit is set, going over it
+// warns or exits.  The reports combine the accounts over the
+// ranks and compare them to the resident memory the kernel
+// gives in /proc/self/status.  Accounts are set outside of
+// parallel regions, and every rank must open the same ones
+//**********************************************************
+
+class memory_account_set
+{
+
+ private:
+
+  struct account
+  {
+    std::string name;
+    double bytes;       // held now
+    double projected;   // the most it is expected to hold
+  };
+  std::vector<account> accounts_;
+  std::map<std::string,int> index_;
+
+  // totals over the accounts of this rank, and the most it
+  // has ever held
+  double total_, projected_, peak_;
+
+  double limit_;         // bytes per rank (0 for none)
+  int abort_;            // exit (rather than warn) over the limit
+  int over_;             // now over the limit (and warned)
+  int verbose_;
+
+  void check_limit(const std::string &name);
+
+ public:
+
+  memory_account_set() : total_(0), projected_(0), peak_(0), limit_(0),
+    abort_(0), over_(0), verbose_(0) {}
+
+  void init(double limit_mb, int abort, int verbose);
+
+  // set the bytes held by account name, and the most it may
+  // grow to (if more), checking them against the limit
+  void set(const std::string &name, double bytes, double projected = 0);
+  double total() const {return total_;}
+
+  // the resident memory of this process and its high-water
+  // mark (bytes; 0 if unknown)
+  static void resident(double &rss, double &hwm);
+
+  // print the accounts combined over the ranks (all ranks
+  // must call these): the whole table, and one line a step
+  void report(const char *title);
+  void report_step(int step);
+};
+
+//---------------------------------------------------------
+// the memory accounts of this process
+//---------------------------------------------------------
+inline memory_account_set& memory_accounts()
+{
+  static memory_account_set accounts;
+  return accounts;
+}
+
+#endif
@@ -0,0 +1,115 @@
+#include <string.h>
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+
+const char* perf_counters::name(int k)
+{
+  const char *names[n_counters] =
+    {"cycles","instructions","cache_misses","branch_misses","tlb_misses"};
+  return names[k];
+}
+
+perf_counters::perf_counters()
+{
+  leader_ = -1;
+  for (int k=0;k<n_counters;k++) {fd_[k] = -1; id_[k] = 0;}
+}
+
+
+//---------------------------------------------------------
+// Open the counters of the calling thread (on any cpu),
+// counting user space only so that the usual paranoid
+// setting allows it.  The first counter that opens leads
+// the group; counters that fail to open are left out
+//---------------------------------------------------------
+int perf_counters::open()
+{
+  int n_open = 0;
+#ifdef __linux__
+  if (is_open()) return n_open;
+
+  for (int k=0;k<n_counters;k++)
+  {
+    struct perf_event_attr pe;
+    memset(&pe,0,sizeof(pe));
+    pe.size = sizeof(pe);
+    pe.type = PERF_TYPE_HARDWARE;
+    if      (k == cycles)        pe.config = PERF_COUNT_HW_CPU_CYCLES;
+    else if (k == instructions)  pe.config = PERF_COUNT_HW_INSTRUCTIONS;
+    else if (k == cache_misses)  pe.config = PERF_COUNT_HW_CACHE_MISSES;
+    else if (k == branch_misses) pe.config = PERF_COUNT_HW_BRANCH_MISSES;
+    else
+    {
+      // data TLB misses on loads
+      pe.type   = PERF_TYPE_HW_CACHE;
+      pe.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+    pe.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv     = 1;
+    pe.disabled       = (leader_ < 0);
+
+    int group = (leader_ < 0) ? -1 : fd_[leader_];
+    int fd = syscall(__NR_perf_event_open,&pe,0,-1,group,0);
+    if (fd < 0) continue;
+    if (ioctl(fd,PERF_EVENT_IOC_ID,&id_[k]) < 0)
+    {
+      ::close(fd);
+      continue;
+    }
+    fd_[k] = fd;
+    if (leader_ < 0) leader_ = k;
+    n_open++;
+  }
+
+  if (leader_ >= 0)
+  {
+    ioctl(fd_[leader_],PERF_EVENT_IOC_RESET,PERF_IOC_FLAG_GROUP);
+    ioctl(fd_[leader_],PERF_EVENT_IOC_ENABLE,PERF_IOC_FLAG_GROUP);
+  }
+#endif
+  return n_open;
+}
+
+
+void perf_counters::close()
+{
+#ifdef __linux__
+  for (int k=0;k<n_counters;k++)
+    if (fd_[k] >= 0) ::close(fd_[k]);
+#endif
+  leader_ = -1;
+  for (int k=0;k<n_counters;k++) fd_[k] = -1;
+}
+
+
+//---------------------------------------------------------
+// Read the whole group at once, and scale the counts up by
+// the fraction of the time the group was on the hardware
+// (it is time shared if there are too few hardware counters)
+//---------------------------------------------------------
+void perf_counters::read(double counts[n_counters]) const
+{
+  for (int k=0;k<n_counters;k++) counts[k] = 0;
+#ifdef __linux__
+  if (leader_ < 0) return;
+
+  // nr, time enabled, time running, then (value, id) pairs
+  unsigned long long buf[3 + 2*n_counters];
+  if (::read(fd_[leader_],buf,sizeof(buf)) < (ssize_t)(3*sizeof(buf[0]))) return;
+  unsigned long long nr = buf[0];
+  double scale = (buf[2] > 0) ? (double)buf[1]/buf[2] : 0;
+  for (unsigned long long j=0;(j<nr)&&(j<n_counters);j++)
+    for (int k=0;k<n_counters;k++)
+      if ((fd_[k] >= 0)&&(id_[k] == buf[4 + 2*j])) counts[k] = scale*buf[3 + 2*j];
+#endif
+}
@@ -0,0 +1,42 @@
+#ifndef _PERF_COUNTERS_H
+#define _PERF_COUNTERS_H 1
+
+//**********************************************************
+// Hardware performance counters of the calling thread, read
+// with the Linux perf_event_open system call.  The counters
+// are opened as one group (so they count over the same
+// time) and scaled for the time the kernel had them on the
+// hardware.  Counters the machine or the kernel settings
+// (perf_event_paranoid) don't allow are left out, and where
+// there is no perf_event (or not Linux) none are open
+//**********************************************************
+
+class perf_counters
+{
+
+ public:
+
+  enum Counter {cycles, instructions, cache_misses, branch_misses, tlb_misses,
+    n_counters};
+  static const char* name(int k);
+
+  perf_counters();
+
+  // open the counters of the calling thread; returns the
+  // number that could be opened
+  int  open();
+  void close();
+  bool is_open() const {return (leader_ >= 0);}
+  bool available(int k) const {return (fd_[k] >= 0);}
+
+  // the counts so far (0 for counters that aren't open)
+  void read(double counts[n_counters]) const;
+
+ private:
+
+  int fd_[n_counters];
+  unsigned long long id_[n_counters];
+  int leader_;    // counter leading the group
+};
+
+#endif
@@ -0,0 +1,517 @@
+#include <iostream>
+#include <algorithm>
+#include "sedona.h"
+#include "phase_timer.h"
+
+#ifdef MPI_PARALLEL
+#include <mpi.h>
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using std::string;
+using std::vector;
+
+
+//---------------------------------------------------------
+// little helpers for the thread number and whether we are
+// in an (active) parallel region
+//---------------------------------------------------------
+static int thread_number()
+{
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+static bool in_parallel()
+{
+#ifdef _OPENMP
+  return omp_in_parallel();
+#else
+  return false;
+#endif
+}
+
+
+//---------------------------------------------------------
+// Turn the timers on or off, and open the timing file (on
+// the verbose rank, if a name is given).  With counters,
+// the hardware counters are read too: those of this thread
+// are opened here, and those of the other threads when they
+// first open a phase
+//---------------------------------------------------------
+void phase_timer_set::init(int enabled, string filename, int verbose, int counters)
+{
+  enabled_  = enabled;
+  counters_ = (enabled && counters);
+  verbose_  = verbose;
+#ifdef _OPENMP
+  threads_.resize(omp_get_max_threads());
+#else
+  threads_.resize(1);
+#endif
+
+  // the counters can't be used on some machines (no counters
+  // in a virtual machine, or a high perf_event_paranoid), in
+  // which case they just stay zero
+  if (counters_)
+  {
+    threads_[0].hw_tried = true;
+    int n = threads_[0].hw.open();
+    if ((verbose_)&&(n == 0))
+      std::cout << "# Hardware performance counters are unavailable; not counting them\n";
+    else if ((verbose_)&&(n < perf_counters::n_counters))
+    {
+      std::cout << "# Hardware performance counters unavailable:";
+      for (int k=0;k<perf_counters::n_counters;k++)
+        if (!threads_[0].hw.available(k)) std::cout << " " << perf_counters::name(k);
+      std::cout << "\n";
+    }
+  }
+
+  if ((!enabled_)||(!verbose_)||(filename == "")) return;
+  file_ = fopen(filename.c_str(),"w");
+  if (file_ == NULL)
+  {
+    std::cerr << "# Can't open timing file " << filename << "; exiting" << std::endl;
+    exit(1);
+  }
+  fprintf(file_,"step,time,phase,calls,rank_min,rank_avg,rank_max,rank_imbalance,");
+  fprintf(file_,"thread_min,thread_avg,thread_max,thread_imbalance,items");
+  if (counters_)
+    for (int k=0;k<perf_counters::n_counters;k++)
+      fprintf(file_,",%s",perf_counters::name(k));
+  fprintf(file_,"\n");
+}
+
+
+//---------------------------------------------------------
+// Start tracing the phases into the file, keeping the last
+// max_events phases of each thread.  The ranks start their
+// clocks together, so their timelines line up
+//---------------------------------------------------------
+void phase_timer_set::init_trace(string filename, int max_events)
+{
+  if (max_events <= 0)
+  {
+    if (verbose_) std::cerr << "# output_trace_events must be > 0; exiting" << std::endl;
+    exit(1);
+  }
+  tracing_    = 1;
+  trace_file_ = filename;
+  trace_max_  = max_events;
+  if (verbose_)
+  {
+    FILE *f = fopen(filename.c_str(),"w");
+    if (f == NULL)
+    {
+      std::cerr << "# Can't open trace file " << filename << "; exiting" << std::endl;
+      exit(1);
+    }
+    fclose(f);
+  }
+#ifdef MPI_PARALLEL
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+  epoch_ = std::chrono::steady_clock::now();
+}
+
+
+phase_timer_set::~phase_timer_set()
+{
+  for (size_t q=0;q<threads_.size();q++) threads_[q].hw.close();
+  if (file_) fclose(file_);
+}
+
+
+//---------------------------------------------------------
+// index of the phase called name under the phase parent
+// (-1 for the top level), adding it if it is new.  Threads
+// must hold the phase_timers lock to call this
+//---------------------------------------------------------
+int phase_timer_set::find_phase(int parent, const string &name)
+{
+  std::pair<int,string> key(parent,name);
+  std::map< std::pair<int,string>, int >::iterator it = index_.find(key);
+  if (it != index_.end()) return it->second;
+
+  phase p;
+  p.name   = name;
+  p.parent = parent;
+  p.depth  = (parent < 0) ? 0 : phases_[parent].depth + 1;
+  phases_.push_back(p);
+  index_[key] = phases_.size() - 1;
+  return phases_.size() - 1;
+}
+
+
+//---------------------------------------------------------
+// index of the phase with the full path (names separated
+// by "/"), adding it and its parents if new
+//---------------------------------------------------------
+int phase_timer_set::find_path(const string &p)
+{
+  int i = -1;
+  size_t start = 0;
+  while (start <= p.size())
+  {
+    size_t stop = p.find('/',start);
+    if (stop == string::npos) stop = p.size();
+    i = find_phase(i,p.substr(start,stop - start));
+    start = stop + 1;
+  }
+  return i;
+}
+
+
+//---------------------------------------------------------
+// full path of phase i
+//---------------------------------------------------------
+string phase_timer_set::path(int i) const
+{
+  if (phases_[i].parent < 0) return phases_[i].name;
+  return path(phases_[i].parent) + "/" + phases_[i].name;
+}
+
+
+//---------------------------------------------------------
+// Open the phase called name on this thread, returning its
+// index (or -1 if it isn't timed)
+//---------------------------------------------------------
+int phase_timer_set::start(const char *name)
+{
+  size_t t = thread_number();
+  if (t >= threads_.size()) return -1;
+  thread_timers &tt = threads_[t];
+
+  // threads in a parallel region start under the phase
+  // that was open when it began
+  bool parallel = in_parallel();
+  int parent;
+  if (!tt.open.empty()) parent = tt.open.back();
+  else parent = parallel ? serial_phase_ : -1;
+
+  // look up the phase, first in this thread's cache
+  int i;
+  std::pair<int,string> key(parent,name);
+  std::map< std::pair<int,string>, int >::iterator it = tt.index.find(key);
+  if (it != tt.index.end()) i = it->second;
+  else
+  {
+    #pragma omp critical(phase_timers)
+    i = find_phase(parent,key.second);
+    tt.index[key] = i;
+  }
+  if (i >= (int)tt.time.size())
+  {
+    tt.time.resize(i+1,0);
+    tt.calls.resize(i+1,0);
+    tt.items.resize(i+1,0);
+    if (counters_) tt.hw_counts.resize((i+1)*perf_counters::n_counters,0);
+  }
+
+  // the counters when the phase starts
+  if (counters_)
+  {
+    if (!tt.hw_tried) {tt.hw.open(); tt.hw_tried = true;}
+    double c[perf_counters::n_counters];
+    tt.hw.read(c);
+    tt.hw_start.insert(tt.hw_start.end(),c,c + perf_counters::n_counters);
+  }
+
+  tt.open.push_back(i);
+  if (!parallel) serial_phase_ = i;
+  return i;
+}
+
+
+//---------------------------------------------------------
+// Close phase i on this thread, which started at start and
+// took secs
+//---------------------------------------------------------
+void phase_timer_set::stop(int i, std::chrono::steady_clock::time_point start, double secs)
+{
+  thread_timers &tt = threads_[thread_number()];
+  if (tracing_)
+  {
+    std::chrono::duration<double> since = start - epoch_;
+    trace_event e = {i, since.count(), secs};
+    // once the buffer is full, write over the oldest event
+    if (tt.trace.size() < trace_max_) tt.trace.push_back(e);
+    else tt.trace[tt.trace_n % trace_max_] = e;
+    tt.trace_n++;
+  }
+  tt.time[i]  += secs;
+  tt.calls[i] += 1;
+  tt.open.pop_back();
+  if (counters_)
+  {
+    const int nc = perf_counters::n_counters;
+    double c[nc];
+    tt.hw.read(c);
+    double *c0 = &tt.hw_start[tt.hw_start.size() - nc];
+    for (int k=0;k<nc;k++) tt.hw_counts[i*nc + k] += c[k] - c0[k];
+    tt.hw_start.resize(tt.hw_start.size() - nc);
+  }
+  if (!in_parallel()) serial_phase_ = tt.open.empty() ? -1 : tt.open.back();
+}
+
+
+//---------------------------------------------------------
+// Count n items processed in phase i on this thread
+//---------------------------------------------------------
+void phase_timer_set::count(int i, double n)
+{
+  threads_[thread_number()].items[i] += n;
+}
+
+
+//---------------------------------------------------------
+// Combine the time spent in each phase since the last report
+// over the threads and ranks.  The time of a rank is that of
+// its slowest thread.  The phases reported are those known
+// to rank 0, in tree order.  Prints the times (if verbose)
+// and writes them to the timing file, then clears them.
+// The hardware counts are summed over threads and ranks
+//---------------------------------------------------------
+void phase_timer_set::report(int step, double t)
+{
+  if (!enabled_) return;
+
+  int n_ranks = 1;
+#ifdef MPI_PARALLEL
+  MPI_Comm_size(MPI_COMM_WORLD,&n_ranks);
+#endif
+
+  // list the phases depth first, children in order of creation
+  vector< vector<int> > children(phases_.size());
+  vector<int> order, todo;
+  for (size_t i=0;i<phases_.size();i++)
+    if (phases_[i].parent >= 0) children[phases_[i].parent].push_back(i);
+  for (int i=phases_.size()-1;i>=0;i--)
+    if (phases_[i].parent < 0) todo.push_back(i);
+  while (!todo.empty())
+  {
+    int i = todo.back();
+    todo.pop_back();
+    order.push_back(i);
+    for (int k=children[i].size()-1;k>=0;k--) todo.push_back(children[i][k]);
+  }
+  string paths;
+  for (size_t k=0;k<order.size();k++) paths += path(order[k]) + "\n";
+
+  // use the phases of rank 0 on every rank
+#ifdef MPI_PARALLEL
+  int len = paths.size();
+  MPI_Bcast(&len,1,MPI_INT,0,MPI_COMM_WORLD);
+  paths.resize(len);
+  MPI_Bcast(&paths[0],len,MPI_CHAR,0,MPI_COMM_WORLD);
+#endif
+  vector<int> ids;
+  size_t start = 0;
+  while (start < paths.size())
+  {
+    size_t stop = paths.find('\n',start);
+    ids.push_back(find_path(paths.substr(start,stop - start)));
+    start = stop + 1;
+  }
+  int n = ids.size();
+
+  // my times: rank time and thread min/max (to be reduced
+  // with min and max), rank time, thread sum, number of
+  // threads, calls and items (to be summed)
+  const int nc = perf_counters::n_counters;
+  vector<double> lo(2*n), hi(2*n), sum(5*n), hw(counters_ ? nc*n : 0, 0);
+  for (int k=0;k<n;k++)
+  {
+    int i = ids[k];
+    double rank_time = 0, t_min = 1e300, t_max = 0, t_sum = 0, t_n = 0, calls = 0, items = 0;
+    for (size_t q=0;q<threads_.size();q++)
+    {
+      thread_timers &tt = threads_[q];
+      if ((i >= (int)tt.calls.size())||(tt.calls[i] == 0)) continue;
+      double ti = tt.time[i];
+      rank_time = std::max(rank_time,ti);
+      t_min  = std::min(t_min,ti);
+      t_max  = std::max(t_max,ti);
+      t_sum += ti;
+      t_n   += 1;
+      calls += tt.calls[i];
+      items += tt.items[i];
+      if (counters_)
+        for (int c=0;c<nc;c++) hw[nc*k + c] += tt.hw_counts[nc*i + c];
+    }
+    lo[2*k] = rank_time;  lo[2*k+1] = t_min;
+    hi[2*k] = rank_time;  hi[2*k+1] = t_max;
+    sum[5*k] = rank_time; sum[5*k+1] = t_sum; sum[5*k+2] = t_n; sum[5*k+3] = calls;
+    sum[5*k+4] = items;
+  }
+#ifdef MPI_PARALLEL
+  vector<double> recv(5*n);
+  if (n > 0)
+  {
+    MPI_Reduce(&lo[0],&recv[0],2*n,MPI_DOUBLE,MPI_MIN,0,MPI_COMM_WORLD);
+    for (int k=0;k<2*n;k++) lo[k] = recv[k];
+    MPI_Reduce(&hi[0],&recv[0],2*n,MPI_DOUBLE,MPI_MAX,0,MPI_COMM_WORLD);
+    for (int k=0;k<2*n;k++) hi[k] = recv[k];
+    MPI_Reduce(&sum[0],&recv[0],5*n,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
+    for (int k=0;k<5*n;k++) sum[k] = recv[k];
+    if (counters_)
+    {
+      recv.resize(nc*n);
+      MPI_Reduce(&hw[0],&recv[0],nc*n,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
+      hw = recv;
+    }
+  }
+#endif
+
+  // clear the times for the next report
+  for (size_t q=0;q<threads_.size();q++)
+  {
+    threads_[q].time.assign(threads_[q].time.size(),0);
+    threads_[q].calls.assign(threads_[q].calls.size(),0);
+    threads_[q].items.assign(threads_[q].items.size(),0);
+    threads_[q].hw_counts.assign(threads_[q].hw_counts.size(),0);
+  }
+  if (!verbose_) return;
+
+  printf("# Timing (secs)                        calls        avg        max  imbal  thr_imbal\n");
+  for (int k=0;k<n;k++)
+  {
+    double calls = sum[5*k+3];
+    if (calls == 0) continue;
+    const phase &p = phases_[ids[k]];
+    double r_avg = sum[5*k]/n_ranks;
+    double t_avg = sum[5*k+1]/sum[5*k+2];
+    double r_imb = (r_avg > 0) ? hi[2*k]/r_avg : 1;
+    double t_imb = (t_avg > 0) ? hi[2*k+1]/t_avg : 1;
+
+    string name = string(2*p.depth,' ') + p.name;
+    printf("#   %-32s %8.0f %10.3e %10.3e %6.2f %10.2f\n",name.c_str(),calls,
+      r_avg,hi[2*k],r_imb,t_imb);
+    if (file_)
+    {
+      fprintf(file_,"%d,%.6e,%s,%.0f,%.6e,%.6e,%.6e,%.4f,%.6e,%.6e,%.6e,%.4f,%.0f",
+        step,t,path(ids[k]).c_str(),calls,lo[2*k],r_avg,hi[2*k],r_imb,
+        lo[2*k+1],t_avg,hi[2*k+1],t_imb,sum[5*k+4]);
+      // (blank for counters this rank couldn't open)
+      for (int c=0;(counters_)&&(c<nc);c++)
+        if (threads_[0].hw.available(c)) fprintf(file_,",%.0f",hw[nc*k + c]);
+        else fprintf(file_,",");
+      fprintf(file_,"\n");
+    }
+  }
+  if (file_) fflush(file_);
+
+  // instructions per cycle, and misses per 1000 instructions
+  if (!counters_) return;
+  const perf_counters &pc = threads_[0].hw;
+  if (!pc.available(perf_counters::instructions)) return;
+  printf("# Counters                                 IPC  cache/kI  branch/kI     tlb/kI\n");
+  for (int k=0;k<n;k++)
+  {
+    double ins = hw[nc*k + perf_counters::instructions];
+    if ((sum[5*k+3] == 0)||(ins <= 0)) continue;
+    const phase &p = phases_[ids[k]];
+    string name = string(2*p.depth,' ') + p.name;
+    printf("#   %-32s",name.c_str());
+    if (pc.available(perf_counters::cycles))
+      printf(" %8.2f",ins/hw[nc*k + perf_counters::cycles]);
+    else printf(" %8s","-");
+    int miss[3] = {perf_counters::cache_misses,perf_counters::branch_misses,
+      perf_counters::tlb_misses};
+    for (int m=0;m<3;m++)
+      if (pc.available(miss[m])) printf(" %9.3f",1000*hw[nc*k + miss[m]]/ins);
+      else printf(" %9s","-");
+    printf("\n");
+  }
+}
+
+
+//---------------------------------------------------------
+// Write the traced phases as a Chrome trace-event file: one
+// complete ("X") event per phase, with the rank as the
+// process and the OpenMP thread as the thread.  Each rank
+// writes its events as text, and rank 0 gathers them into
+// the file
+//---------------------------------------------------------
+void phase_timer_set::write_trace()
+{
+  if (!tracing_) return;
+
+  int my_rank = 0, n_ranks = 1;
+#ifdef MPI_PARALLEL
+  MPI_Comm_rank(MPI_COMM_WORLD,&my_rank);
+  MPI_Comm_size(MPI_COMM_WORLD,&n_ranks);
+#endif
+
+  // my events, oldest first on each thread
+  string text;
+  char buf[512];
+  long n_events = 0, n_dropped = 0;
+  snprintf(buf,sizeof(buf),"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+    "\"args\":{\"name\":\"rank %d\"}},\n",my_rank,my_rank);
+  text += buf;
+  for (size_t q=0;q<threads_.size();q++)
+  {
+    thread_timers &tt = threads_[q];
+    if (tt.trace.empty()) continue;
+    snprintf(buf,sizeof(buf),"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+      "\"tid\":%d,\"args\":{\"name\":\"thread %d\"}},\n",my_rank,(int)q,(int)q);
+    text += buf;
+    size_t first = (tt.trace.size() < trace_max_) ? 0 : tt.trace_n % trace_max_;
+    for (size_t j=0;j<tt.trace.size();j++)
+    {
+      const trace_event &e = tt.trace[(first + j) % tt.trace.size()];
+      snprintf(buf,sizeof(buf),"{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\","
+        "\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"path\":\"%s\"}},\n",
+        phases_[e.phase].name.c_str(),my_rank,(int)q,1e6*e.start,1e6*e.secs,
+        path(e.phase).c_str());
+      text += buf;
+    }
+    n_events  += tt.trace.size();
+    n_dropped += tt.trace_n - tt.trace.size();
+    tt.trace.clear();
+    tt.trace_n = 0;
+  }
+
+  // gather the text of all ranks on rank 0
+  int len = text.size();
+  vector<int> lens(n_ranks,len), offsets(n_ranks,0);
+  string all = text;
+#ifdef MPI_PARALLEL
+  MPI_Gather(&len,1,MPI_INT,&lens[0],1,MPI_INT,0,MPI_COMM_WORLD);
+  for (int r=1;r<n_ranks;r++) offsets[r] = offsets[r-1] + lens[r-1];
+  if (my_rank == 0) all.resize(offsets[n_ranks-1] + lens[n_ranks-1]);
+  MPI_Gatherv(&text[0],len,MPI_CHAR,&all[0],&lens[0],&offsets[0],MPI_CHAR,0,MPI_COMM_WORLD);
+  long counts[2] = {n_events,n_dropped}, total[2];
+  MPI_Reduce(counts,total,2,MPI_LONG,MPI_SUM,0,MPI_COMM_WORLD);
+  n_events  = total[0];
+  n_dropped = total[1];
+#endif
+  if (my_rank != 0) return;
+
+  FILE *f = fopen(trace_file_.c_str(),"w");
+  if (f == NULL)
+  {
+    std::cerr << "# Can't open trace file " << trace_file_ << std::endl;
+    return;
+  }
+  // (drop the comma after the last event)
+  fprintf(f,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fwrite(all.c_str(),1,all.size() - 2,f);
+  fprintf(f,"\n]}\n");
+  fclose(f);
+
+  if (verbose_)
+  {
+    std::cout << "# Wrote " << n_events << " traced phases to " << trace_file_;
+    if (n_dropped > 0)
+      std::cout << " (dropped the " << n_dropped << " oldest; raise output_trace_events)";
+    std::cout << "\n";
+  }
+}
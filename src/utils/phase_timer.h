@@ -0,0 +1,173 @@
+#ifndef _PHASE_TIMER_H
+#define _PHASE_TIMER_H 1
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cstdio>
+#include "perf_counters.h"
+
+//**********************************************************
+// Wall clock timers of the named phases of a calculation.
+// A phase_timer object times the code from its construction
+// to the end of its scope, and phases opened while another
+// is open are nested in it.  Phases opened by the threads of
+// an OpenMP parallel region are nested in the phase open
+// when the region started.  Each thread accumulates its own
+// times, and report() combines them over the threads and MPI
+// ranks, prints them and writes them to a file.  A phase can
+// also count the items (e.g. particles) it processed, so the
+// file gives its throughput.  Optionally the hardware
+// counters (cycles, instructions, cache, branch and TLB
+// misses) of each thread are read when a phase opens and
+// closes, and the report gives the IPC and miss rates of
+// each phase.  The timers can also trace the phases: each
+// thread keeps the start and end of its most recent phases
+// in a ring buffer, and write_trace() merges them over the
+// threads and ranks into a Chrome trace-event JSON file,
+// which shows the timeline in chrome://tracing or Perfetto.
+// When the timers and tracing are off a phase_timer only
+// checks a flag
+//**********************************************************
+
+class phase_timer_set
+{
+
+ private:
+
+  // the tree of phases, shared by the threads
+  struct phase
+  {
+    std::string name;
+    int parent;
+    int depth;
+  };
+  std::vector<phase> phases_;
+  std::map< std::pair<int,std::string>, int > index_;
+
+  // a phase traced on a thread (secs since the epoch)
+  struct trace_event
+  {
+    int phase;
+    double start;
+    double secs;
+  };
+
+  // what each thread keeps: the phases open on it, its cache
+  // of the phase index, and the time and number of calls it
+  // spent in each phase, and the items it counted, since the
+  // last report.  With counters on, also its hardware
+  // counters, their values when each open phase started, and
+  // the counts in each phase (n_counters per phase)
+  struct thread_timers
+  {
+    std::vector<int> open;
+    std::map< std::pair<int,std::string>, int > index;
+    std::vector<double> time;
+    std::vector<long> calls;
+    std::vector<double> items;
+    perf_counters hw;
+    bool hw_tried;
+    std::vector<double> hw_start;
+    std::vector<double> hw_counts;
+    std::vector<trace_event> trace;
+    long trace_n;
+    thread_timers() : hw_tried(false), trace_n(0) {}
+  };
+  std::vector<thread_timers> threads_;
+
+  // innermost phase open outside of parallel regions
+  int serial_phase_;
+
+  int enabled_;
+  int counters_;
+  int verbose_;
+  FILE *file_;
+
+  // tracing: the file to write, the events kept per thread
+  // and when the trace started
+  int tracing_;
+  std::string trace_file_;
+  size_t trace_max_;
+  std::chrono::steady_clock::time_point epoch_;
+
+  int find_phase(int parent, const std::string &name);
+  int find_path(const std::string &path);
+  std::string path(int i) const;
+
+ public:
+
+  phase_timer_set() : serial_phase_(-1), enabled_(0), counters_(0), verbose_(0),
+    file_(NULL), tracing_(0), trace_max_(0) {}
+  ~phase_timer_set();
+
+  void init(int enabled, std::string filename, int verbose, int counters = 0);
+  int enabled() const {return (enabled_ || tracing_);}
+
+  // trace the phases, keeping the last max_events of each
+  // thread (all ranks must call this, after init)
+  void init_trace(std::string filename, int max_events);
+
+  // open and close a phase on this thread (use phase_timer)
+  int  start(const char *name);
+  void stop(int i, std::chrono::steady_clock::time_point start, double secs);
+  void count(int i, double n);
+
+  // combine, print and write out the times since the last
+  // report, and clear them (all ranks must call this)
+  void report(int step, double t);
+
+  // write the traced phases of all threads and ranks to the
+  // trace file (all ranks must call this)
+  void write_trace();
+};
+
+//---------------------------------------------------------
+// the timers of this process
+//---------------------------------------------------------
+inline phase_timer_set& phase_timers()
+{
+  static phase_timer_set timers;
+  return timers;
+}
+
+
+//**********************************************************
+// times the phase "name" until it goes out of scope
+//**********************************************************
+class phase_timer
+{
+  typedef std::chrono::steady_clock clock;
+  clock::time_point start_;
+  int phase_;
+
+ public:
+
+  phase_timer(const char *name) : phase_(-1)
+  {
+    phase_timer_set &timers = phase_timers();
+    if (!timers.enabled()) return;
+    phase_ = timers.start(name);
+    start_ = clock::now();
+  }
+
+  ~phase_timer() {stop();}
+
+  // count n items processed in the phase
+  void count(double n)
+  {
+    if (phase_ >= 0) phase_timers().count(phase_,n);
+  }
+
+  // end the phase before the end of the scope
+  void stop()
+  {
+    if (phase_ < 0) return;
+    std::chrono::duration<double> secs = clock::now() - start_;
+    phase_timers().stop(phase_,start_,secs.count());
+    phase_ = -1;
+  }
+};
+
+#endif
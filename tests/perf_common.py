@@ -0,0 +1,105 @@
+import os
+import shutil
+import subprocess
+import timeit
+import csv
+
+
+###############################################
+# helpers shared by run_perf_suite.py and
+# run_scaling.py: running a sedona problem once
+# with a fixed random seed and the phase timers
+# on, and reading back its timings
+###############################################
+
+
+###########################################
+# copy the problem's parameter file to run_param,
+# adding the seed, the timers and any extra lua
+# lines (params is separated by ";", extra is a list)
+###########################################
+def write_params(paramname, run_param, timing_file, seed, params, extra=[], script="perf_common.py"):
+    shutil.copy(paramname,run_param)
+    fout = open(run_param,"a")
+    fout.write("\n-- added by " + script + "\n")
+    fout.write("transport_fix_rng_seed = 1\n")
+    fout.write("transport_rng_seed = " + str(seed) + "\n")
+    fout.write("output_timing = 1\n")
+    fout.write("output_timing_file = \"" + timing_file + "\"\n")
+    for line in params.split(';'):
+        if (line.strip() != ""): fout.write(line.strip() + "\n")
+    for line in extra:
+        fout.write(line + "\n")
+    fout.close()
+
+
+###########################################
+# run the executable on ranks x threads, appending
+# its output to logfile under the given label.
+# mpirun is how to launch on n ranks (n is added
+# after it); {threads} in it is replaced by the
+# threads per rank.  Returns the exit status and
+# the wall time
+###########################################
+def launch(executable, run_param, mpirun, ranks, threads, logfile, label):
+    env = dict(os.environ)
+    env['OMP_NUM_THREADS'] = str(threads)
+    cmd = mpirun.replace("{threads}",str(threads)).split() + [str(ranks),executable,run_param]
+    log = open(logfile,"a")
+    log.write("\n-- RUNNING: " + label + "\n")
+    log.flush()
+    starttime = timeit.default_timer()
+    status = subprocess.call(cmd,stdout=log,stderr=subprocess.STDOUT,env=env)
+    wall = timeit.default_timer() - starttime
+    log.close()
+    return status, wall
+
+
+###########################################
+# read the timing file of a run: the time of the
+# slowest rank in each phase summed over the steps,
+# the number of steps, and the particles propagated
+# per second (if any were)
+###########################################
+def read_timing(timing_file):
+    phases = {}
+    n_steps = 0
+    n_particles = 0
+    t_propagate = 0
+    for row in csv.DictReader(open(timing_file)):
+        p = row['phase']
+        phases[p] = phases.get(p,0) + float(row['rank_max'])
+        if (p == 'step'): n_steps += 1
+        if (p.endswith('/propagate')):
+            n_particles += float(row['items'])
+            t_propagate += float(row['rank_max'])
+
+    result = {'phases': phases, 'steps': n_steps}
+    if (t_propagate > 0):
+        result['particles_per_sec'] = n_particles/t_propagate
+    return result
+
+
+###########################################
+# run a problem once (in the current directory),
+# returning its results (wall, phases, steps and
+# particles_per_sec), or None if it failed
+###########################################
+def run_once(opts, executable, ranks, threads, paramname, run_param, timing_file,
+             logfile, label, extra=[], script="perf_common.py"):
+    write_params(paramname,run_param,timing_file,opts.seed,opts.params,extra,script)
+    if (os.path.isfile(timing_file)): os.remove(timing_file)
+
+    status, wall = launch(executable,run_param,opts.mpirun,ranks,threads,logfile,label)
+    os.remove(run_param)
+    if (status != 0 or not os.path.isfile(timing_file)):
+        return None
+
+    result = read_timing(timing_file)
+    result['wall'] = wall
+    os.remove(timing_file)
+    return result
+
+
+def mean(x):
+    return sum(x)/len(x)
@@ -0,0 +1,236 @@
+#!/usr/bin/env python
+import os, sys
+import json
+import math
+import time
+import optparse
+import perf_common
+from perf_common import mean
+
+
+###############################################
+# runs a series of sedona test problems to
+# track the performance of the code
+#
+# each test is run several times with a fixed
+# random seed and a fixed number of mpi ranks and
+# threads, with the phase timers on (output_timing).
+# For each run we keep the wall time, the time of
+# each phase (of the slowest rank, summed over the
+# steps) and the number of particles propagated per
+# second.  The results are written to a JSON file,
+# and can be compared to a baseline JSON file from an
+# earlier run.  A test is flagged as a slowdown when
+# its mean time is both
+#   - larger than the baseline by more than --sigma
+#     times the noise (the standard error of the
+#     difference of the two means), and
+#   - larger than the baseline by more than the
+#     fraction --threshold
+# (and likewise for a drop in particles per second)
+#
+# Usage:
+#  python run_perf_suite.py [options]
+# Options:
+#
+#  -n 2            number of mpi ranks
+#  --threads 4     number of OpenMP threads per rank
+#  -r 5            number of runs of each test
+#  --seed 7        random seed of the runs
+#
+#  --testlist "spherical_lightbulb/1D","lucy_supernova/1D"
+#   (will run the tests given after the --testlist flag)
+#
+#  --testfile "my_tests.txt"
+#   (will read the list of tests from the file; the
+#    default is "perf_test_list")
+#
+#  --params "tstep_max_steps = 5"
+#   (lua lines added to the parameter file of every
+#    test, separated by ";")
+#
+#  --exec ../src/build/gomc   executable to run
+#  --mpirun "mpirun -np"      how to launch it on n ranks
+#  --outfile perf             results go to perf.json
+#  --baseline perf_old.json   compare to these results
+#  --threshold 0.05 --sigma 3 when to flag a slowdown
+#
+# returns 1 if any test is slower than the baseline
+###########################################
+
+parser = optparse.OptionParser()
+parser.add_option("-n",dest="nproc",type="int",default=1)
+parser.add_option("--threads",dest="nthreads",type="int",default=1)
+parser.add_option("-r",dest="repeats",type="int",default=3)
+parser.add_option("--seed",dest="seed",type="int",default=7)
+parser.add_option("--testlist","-t",dest="testlist",type="string")
+parser.add_option("--testfile","-f",dest="testfile",type="string")
+parser.add_option("--params",dest="params",type="string",default="")
+parser.add_option("--exec",dest="executable",type="string",default="../src/build/gomc")
+parser.add_option("--mpirun",dest="mpirun",type="string",default="mpirun -np")
+parser.add_option("--outfile","-o",dest="outfile",type="string")
+parser.add_option("--baseline","-b",dest="baseline",type="string")
+parser.add_option("--threshold",dest="threshold",type="float",default=0.05)
+parser.add_option("--sigma",dest="sigma",type="float",default=3.0)
+parser.add_option("--min_time",dest="min_time",type="float",default=0.05)
+parser.add_option("-v",action="store_true",dest="verbose")
+
+(opts, args) = parser.parse_args()
+
+paramname   = "param.lua"
+perf_param  = "perf_param.lua"
+timing_file = "perf_timing.csv"
+executable  = os.path.abspath(opts.executable)
+
+homedir = os.getcwd()
+date = time.strftime("%m-%d-%y")
+if (opts.outfile):
+    outfile = os.path.join(homedir,opts.outfile + '.json')
+else:
+    outfile = homedir + '/perf_results_' + date + '.json'
+logfile = outfile[:-5] + '.txt'
+
+if (not os.path.isfile(executable)):
+    print("can't find executable " + executable)
+    sys.exit(1)
+
+
+########################################
+
+# get list of tests either from input flag
+if (opts.testlist):
+    testlist = opts.testlist.split(',')
+# or else from the default list file
+else:
+    testfile_name = "perf_test_list"
+    if (opts.testfile): testfile_name = opts.testfile
+    fin = open(testfile_name,"r")
+    testlist = []
+    for line in fin:
+        line = line.rstrip('\n')
+        line = line.rstrip(' ')
+        if (os.path.isdir(line)):
+            testlist.append(line)
+
+
+###########################################
+# run one test once, returning its results
+###########################################
+def run_once(this_test):
+    return perf_common.run_once(opts,executable,opts.nproc,opts.nthreads,paramname,
+        perf_param,timing_file,logfile,this_test,script="run_perf_suite.py")
+
+
+###########################################
+# statistics of repeated runs
+###########################################
+def stderr(x):
+    if (len(x) < 2): return 0.0
+    m = mean(x)
+    var = sum((v - m)**2 for v in x)/(len(x) - 1)
+    return math.sqrt(var/len(x))
+
+# compare new runs to the baseline runs of a quantity;
+# slower says whether an increase is a slowdown.  Returns the
+# relative change, the change in units of the noise, and
+# whether it is a significant slowdown
+def compare(new, base, slower=True):
+    m_new, m_base = mean(new), mean(base)
+    noise = math.sqrt(stderr(new)**2 + stderr(base)**2)
+    diff = (m_new - m_base) if slower else (m_base - m_new)
+    rel = diff/m_base if m_base > 0 else 0.0
+    if (noise > 0): nsig = diff/noise
+    else: nsig = float('inf') if diff > 0 else 0.0
+    flag = (nsig > opts.sigma) and (rel > opts.threshold)
+    return rel, nsig, flag
+
+
+###########################################
+# run the tests
+###########################################
+print("Performance of SEDONA code on " + date + "\n")
+print("Will run " + str(len(testlist)) + " tests " + str(opts.repeats) + " times each on "
+      + str(opts.nproc) + " mpi ranks, with " + str(opts.nthreads) + " threads per rank\n")
+
+results = {'meta': {'date': date, 'nproc': opts.nproc, 'nthreads': opts.nthreads,
+                    'repeats': opts.repeats, 'seed': opts.seed, 'params': opts.params,
+                    'executable': executable},
+           'tests': {}}
+
+for this_test in testlist:
+    print("------------------------------------------")
+    print("- " + this_test)
+    os.chdir(this_test)
+    runs = []
+    for r in range(opts.repeats):
+        res = run_once(this_test)
+        if (res is None):
+            print("  run " + str(r+1) + " CRASHED")
+            break
+        if (opts.verbose):
+            print("  run {:d}: {:.2f} secs".format(r+1,res['wall']))
+        runs.append(res)
+    os.chdir(homedir)
+    if (len(runs) == 0): continue
+
+    # collect the runs of each quantity
+    test = {'wall': [x['wall'] for x in runs], 'phases': {}}
+    for p in runs[0]['phases']:
+        if all(p in x['phases'] for x in runs):
+            test['phases'][p] = [x['phases'][p] for x in runs]
+    if all('particles_per_sec' in x for x in runs):
+        test['particles_per_sec'] = [x['particles_per_sec'] for x in runs]
+    results['tests'][this_test] = test
+
+    line = "  wall = {:.2f} +/- {:.2f} secs".format(mean(test['wall']),stderr(test['wall']))
+    if ('particles_per_sec' in test):
+        line += "; {:.3e} particles/sec".format(mean(test['particles_per_sec']))
+    print(line)
+
+fout = open(outfile,"w")
+json.dump(results,fout,indent=1,sort_keys=True)
+fout.close()
+print("\nresults written to " + outfile)
+
+
+###########################################
+# compare to the baseline
+###########################################
+if (not opts.baseline): sys.exit(0)
+
+base = json.load(open(opts.baseline))
+bm = base['meta']
+if (bm['nproc'] != opts.nproc or bm['nthreads'] != opts.nthreads or bm['seed'] != opts.seed
+    or bm.get('params','') != opts.params):
+    print("WARNING: baseline was run with different ranks/threads/seed/params")
+
+print("\nComparison to baseline " + opts.baseline)
+print("(flagged if slower by > {:.0f}% and > {:.1f} sigma)\n".format(100*opts.threshold,opts.sigma))
+print("{:<40s} {:>10s} {:>10s} {:>8s} {:>7s}".format("test/quantity","base","new","change","sigma"))
+
+n_slow = 0
+for this_test in testlist:
+    if (this_test not in results['tests'] or this_test not in base['tests']): continue
+    new_t, base_t = results['tests'][this_test], base['tests'][this_test]
+
+    # wall time, throughput and phases that take long enough
+    # to time reliably
+    items = [('wall',new_t['wall'],base_t['wall'],True)]
+    if ('particles_per_sec' in new_t and 'particles_per_sec' in base_t):
+        items.append(('particles/sec',new_t['particles_per_sec'],base_t['particles_per_sec'],False))
+    for p in sorted(base_t['phases']):
+        if (p in new_t['phases'] and mean(base_t['phases'][p]) >= opts.min_time):
+            items.append((p,new_t['phases'][p],base_t['phases'][p],True))
+
+    print(this_test)
+    for name, new, old, slower in items:
+        rel, nsig, flag = compare(new,old,slower)
+        if (flag): n_slow += 1
+        sign = 1 if slower else -1
+        print("  {:<38s} {:10.3e} {:10.3e} {:+7.1f}% {:7.1f} {:s}".format(
+            name,mean(old),mean(new),100*sign*rel,nsig,"SLOWER" if flag else ""))
+
+if (n_slow > 0):
+    print("\n" + str(n_slow) + " significant slowdowns")
+    sys.exit(1)
+print("\nno significant slowdowns")
@@ -0,0 +1,258 @@
+#!/usr/bin/env python
+import os, sys
+import json
+import math
+import time
+import optparse
+import perf_common
+from perf_common import mean
+
+
+###############################################
+# measures how a sedona problem scales over MPI
+# ranks and OpenMP threads on one node
+#
+# a problem (a directory with a param.lua file) is
+# run with each layout of ranks x threads, with a
+# fixed random seed and the phase timers on
+# (output_timing).  The wall time, the time of each
+# phase (of the slowest rank, summed over the steps)
+# and the particles propagated per second are
+# collected, and the parallel efficiency of each
+# layout relative to the smallest one is tabulated.
+#
+# strong scaling: the problem is the same for every
+#   layout; efficiency = (T_ref*cores_ref)/(T*cores)
+# weak scaling: the particle counts given by --weak
+#   are multiplied by the number of cores (ranks x
+#   threads), and the model can be swapped for a
+#   finer one with --models; efficiency = T_ref/T
+# (the speedup is efficiency*cores/cores_ref, so for
+# weak scaling it is the scaled speedup)
+#
+# Usage:
+#  python run_scaling.py [options] problem_dir
+# Options:
+#
+#  --ranks 1,2,4 --threads 1,2   sweep all combinations
+#  --layouts 1x1,2x1,2x2         or give ranks x threads
+#  --max_cores 8                 skip larger layouts
+#                                (default: cores on node)
+#  -r 3                          runs of each layout
+#  --seed 7                      random seed of the runs
+#
+#  --weak "core_n_emit=1e4,particles_n_emit_radioactive=1e4"
+#   (weak scaling; the particles per core of each
+#    parameter)
+#  --models "1=../models/m_64.h5,8=../models/m_128.h5"
+#   (weak scaling; the model run on >= that many cores)
+#
+#  --params "tstep_max_steps = 5"
+#   (lua lines added to the parameter file, separated
+#    by ";")
+#  --phases "step/transport/opacity,step/transport/propagate"
+#   (phases to tabulate; default: those taking more
+#    than 5% of a step)
+#
+#  --exec ../src/build/gomc   executable to run
+#  --mpirun "mpirun -np"      how to launch it on n ranks;
+#   {threads} is replaced by the threads per rank, e.g.
+#   "mpirun --map-by slot:PE={threads} -np"
+#  --outfile scaling          results go to scaling.json
+###########################################
+
+parser = optparse.OptionParser(usage="usage: %prog [options] problem_dir")
+parser.add_option("--ranks",dest="ranks",type="string",default="1")
+parser.add_option("--threads",dest="threads",type="string",default="1")
+parser.add_option("--layouts",dest="layouts",type="string")
+parser.add_option("--max_cores",dest="max_cores",type="int")
+parser.add_option("-r",dest="repeats",type="int",default=1)
+parser.add_option("--seed",dest="seed",type="int",default=7)
+parser.add_option("--weak",dest="weak",type="string")
+parser.add_option("--models",dest="models",type="string")
+parser.add_option("--params",dest="params",type="string",default="")
+parser.add_option("--phases",dest="phases",type="string")
+parser.add_option("--exec",dest="executable",type="string",default="../src/build/gomc")
+parser.add_option("--mpirun",dest="mpirun",type="string",default="mpirun -np")
+parser.add_option("--outfile","-o",dest="outfile",type="string",default="scaling")
+parser.add_option("-v",action="store_true",dest="verbose")
+
+(opts, args) = parser.parse_args()
+if (len(args) != 1):
+    parser.print_help()
+    sys.exit(1)
+
+problem     = args[0]
+paramname   = "param.lua"
+run_param   = "scaling_param.lua"
+timing_file = "scaling_timing.csv"
+executable  = os.path.abspath(opts.executable)
+homedir     = os.getcwd()
+outfile     = os.path.join(homedir,opts.outfile + '.json')
+logfile     = os.path.join(homedir,opts.outfile + '.txt')
+
+if (not os.path.isfile(executable)):
+    print("can't find executable " + executable)
+    sys.exit(1)
+if (not os.path.isfile(os.path.join(problem,paramname))):
+    print("can't find " + paramname + " in " + problem)
+    sys.exit(1)
+
+
+########################################
+# the layouts (ranks, threads) to run
+########################################
+layouts = []
+if (opts.layouts):
+    for l in opts.layouts.split(','):
+        r, t = l.split('x')
+        layouts.append((int(r),int(t)))
+else:
+    for r in opts.ranks.split(','):
+        for t in opts.threads.split(','):
+            layouts.append((int(r),int(t)))
+max_cores = opts.max_cores
+if (max_cores is None): max_cores = os.cpu_count()
+skipped = [l for l in layouts if l[0]*l[1] > max_cores]
+layouts = sorted([l for l in layouts if l[0]*l[1] <= max_cores],key=lambda l: (l[0]*l[1],l[1]))
+if (len(skipped) > 0):
+    print("skipping layouts with more than " + str(max_cores) + " cores: "
+          + ",".join(str(r) + "x" + str(t) for r, t in skipped))
+if (len(layouts) == 0):
+    print("no layouts to run")
+    sys.exit(1)
+
+# weak scaling particles per core, and models by core count
+weak = []
+if (opts.weak):
+    for w in opts.weak.split(','):
+        name, value = w.split('=')
+        weak.append((name.strip(),float(value)))
+models = []
+if (opts.models):
+    for m in opts.models.split(','):
+        n, f = m.split('=')
+        models.append((int(n),f.strip()))
+    models.sort()
+mode = "weak" if (opts.weak or opts.models) else "strong"
+
+
+###########################################
+# run the problem once with a layout, returning
+# its results
+###########################################
+def run_once(ranks, threads):
+    cores = ranks*threads
+
+    # weak scaling particle counts and model
+    extra = []
+    for name, per_core in weak:
+        extra.append(name + " = " + repr(per_core*cores))
+    model = None
+    for n, f in models:
+        if (n <= cores): model = f
+    if (model is not None):
+        extra.append("model_file = \"" + model + "\"")
+
+    label = str(ranks) + " ranks x " + str(threads) + " threads"
+    result = perf_common.run_once(opts,executable,ranks,threads,paramname,run_param,
+        timing_file,logfile,label,extra,script="run_scaling.py")
+    if (result is not None): result['model'] = model
+    return result
+
+
+###########################################
+# run the layouts
+###########################################
+print("Scaling of " + problem + " (" + mode + " scaling), " + str(opts.repeats)
+      + " runs of each layout\n")
+
+results = {'meta': {'date': time.strftime("%m-%d-%y"), 'problem': problem, 'mode': mode,
+                    'seed': opts.seed, 'params': opts.params, 'weak': opts.weak,
+                    'models': opts.models, 'repeats': opts.repeats,
+                    'executable': executable},
+           'layouts': []}
+
+os.chdir(problem)
+for ranks, threads in layouts:
+    runs = []
+    for r in range(opts.repeats):
+        res = run_once(ranks,threads)
+        if (res is None):
+            print("  " + str(ranks) + "x" + str(threads) + ": run " + str(r+1) + " CRASHED")
+            break
+        if (opts.verbose):
+            print("  {:d}x{:d} run {:d}: {:.2f} secs".format(ranks,threads,r+1,res['wall']))
+        runs.append(res)
+    if (len(runs) == 0): continue
+
+    # the mean over the runs of each quantity
+    lay = {'ranks': ranks, 'threads': threads, 'cores': ranks*threads,
+           'wall': mean([x['wall'] for x in runs]), 'runs': len(runs),
+           'steps': runs[0]['steps'], 'model': runs[0]['model'], 'phases': {}}
+    for p in runs[0]['phases']:
+        if all(p in x['phases'] for x in runs):
+            lay['phases'][p] = mean([x['phases'][p] for x in runs])
+    if all('particles_per_sec' in x for x in runs):
+        lay['particles_per_sec'] = mean([x['particles_per_sec'] for x in runs])
+    results['layouts'].append(lay)
+os.chdir(homedir)
+
+if (len(results['layouts']) == 0):
+    print("no successful runs")
+    sys.exit(1)
+
+
+###########################################
+# parallel efficiency relative to the first
+# (smallest) layout
+###########################################
+ref = results['layouts'][0]
+
+def efficiency(t, t_ref, cores):
+    if (t <= 0): return 0.0
+    if (mode == "strong"): return (t_ref*ref['cores'])/(t*cores)
+    return t_ref/t
+
+# the phases to tabulate
+if (opts.phases):
+    phases = opts.phases.split(',')
+else:
+    t_step = ref['phases'].get('step',0)
+    phases = [p for p in sorted(ref['phases']) if p != 'step'
+              and ref['phases'][p] > 0.05*t_step and p.count('/') <= 2]
+
+for lay in results['layouts']:
+    lay['efficiency'] = efficiency(lay['wall'],ref['wall'],lay['cores'])
+    # (for weak scaling, the scaled speedup)
+    lay['speedup'] = lay['efficiency']*lay['cores']/ref['cores']
+    lay['phase_efficiency'] = {}
+    for p in phases:
+        if (p in lay['phases'] and p in ref['phases']):
+            lay['phase_efficiency'][p] = efficiency(lay['phases'][p],ref['phases'][p],lay['cores'])
+
+fout = open(outfile,"w")
+json.dump(results,fout,indent=1,sort_keys=True)
+fout.close()
+
+print("{:>6s} {:>7s} {:>5s} {:>10s} {:>8s} {:>6s} {:>12s}".format(
+    "ranks","threads","cores","wall(s)","speedup","eff","particles/s"))
+for lay in results['layouts']:
+    pps = lay.get('particles_per_sec',0)
+    print("{:6d} {:7d} {:5d} {:10.3f} {:8.2f} {:6.2f} {:12.4e}".format(
+        lay['ranks'],lay['threads'],lay['cores'],lay['wall'],lay['speedup'],lay['efficiency'],pps))
+
+if (len(phases) > 0):
+    print("\nphase times in secs (efficiency)")
+    print("{:<36s}".format("phase") + "".join("{:>17s}".format(
+        str(l['ranks']) + "x" + str(l['threads'])) for l in results['layouts']))
+    for p in phases:
+        line = "{:<36s}".format(p)
+        for lay in results['layouts']:
+            if (p in lay['phase_efficiency']):
+                line += "{:>10.3e} ({:4.2f})".format(lay['phases'][p],lay['phase_efficiency'][p])
+            else:
+                line += "{:>17s}".format("-")
+        print(line)
+
+print("\nresults written to " + outfile)